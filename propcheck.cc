@@ -1,5 +1,5 @@
 /*
-* propcheck <filename>
+* propcheck [options] <filename>
 * Author: Pradu Kannan
 * Date: Sun Jun 10 16:49:21 MST 2018
 *
@@ -7,7 +7,9 @@
 *
 * Every line except the last line are axioms.
 * The last line is the theorem to prove.
-* Up to 32 variables can be used.
+* A file named *.cnf is read as DIMACS CNF instead: its clauses are the axioms and the
+* theorem is F, so a counterexample is a model of the clauses.
+* The enumerating engine handles up to 64 variables, the others have no limit.
 *
 * Notation for Propositions:
 *    A variable       [A string inside square brackets]
@@ -20,42 +22,216 @@
 *    Not              ![A]                not [A]
 *    True             T                   true
 *    False            F                   false
+*
+* Options:
+*    --engine=NAME    Search strategy:
+*                       enum   exhaustive enumeration, reports the smallest counterexample
+*                       prune  branch and bound over partial assignments in three-valued
+*                              logic, skipping subcubes decided early
+*                       dpll   DPLL search with unit propagation and pure literals over
+*                              the clause form of the propositions
+*                       cdcl   conflict-driven clause learning over the same clauses,
+*                              for large problems
+*                       bdd    reduced ordered binary decision diagrams of the
+*                              propositions, for structured problems with many variables
+*                       portfolio
+*                              enum (up to 64 variables), cdcl and bdd at once on
+*                              separate threads; the first to answer wins, cancels the
+*                              others and is named in the output
+*    --simd=NAME      Vector unit for evaluation: generic, avx2 or avx512
+*                     (default: the widest one the CPU supports)
+*    --jit            Compile the propositions to native x86-64 code
+*    --compile        Compile the propositions to C with the system compiler ($CC, or cc)
+*                     and load the result; builds are cached in $PROPCHECK_CACHE, or
+*                     else propcheck in $XDG_CACHE_HOME or ~/.cache, created private.
+*                     The directory and the builds must be owned by the user and
+*                     writable by no one else.
+*    --gray           Enumerate in Gray-code order, recomputing only the nodes that
+*                     depend on the variable that changed
+*    --tile           Evaluate node by node over tiles of 4096 assignments, sharing the
+*                     dispatch of each node among them
+*    --no-tables      Evaluate every node; by default the enumerator replaces subformulas
+*                     over at most 6 variables beyond the first 6 with lookup tables
+*    --progress       Report enumeration progress on stderr
+*    -j N             Enumerate, or run BDD operations, with N threads; the result is the
+*                     same as with one. In the portfolio the enumerator and bdd take N each.
+*    --shard i/N      Enumerate only shard i (0 <= i < N) of the assignments, to spread
+*                     one problem over several machines. A counterexample is printed as
+*                     usual; otherwise the shard reports whether its assignments
+*                     satisfied the axioms. The smallest shard with a counterexample
+*                     has the smallest counterexample overall. Only with --engine=enum.
+*    --coordinate N   Fork N worker processes, one per shard, and combine their results
+*                     (--engine=enum only)
+*    --checkpoint=S   Save the finished part of an enumeration every S seconds (default
+*                     60, 0 disables) to propcheck-<hash>.ckpt in the working directory,
+*                     and on SIGINT/SIGTERM. The file is removed when the run completes.
+*    --resume         Skip the parts finished according to the checkpoint
+*    --bdd-order=NAME Initial variable order of the bdd engine: force (default) refines
+*                     dfs, the order of a depth-first walk of the propositions, by
+*                     pulling the variables of each small subformula together;
+*                     appearance keeps the order of the input
+*    --no-sift        Keep that order; by default the bdd engine sifts the variables
+*                     to smaller positions whenever the graph has doubled
+*    --no-aig         Run the engines on the propositions as written; by default they are
+*                     first rebuilt as an and-inverter graph, with shared and constant
+*                     subformulas folded, conjunctions balanced and small subformulas
+*                     refactored where that takes fewer gates
+*    --emit-dimacs    Write the clause form of the axioms and the negated theorem to stdout
+*                     in DIMACS CNF, with comments naming the variables, instead of
+*                     checking. For a .cnf input the result is equisatisfiable, not a
+*                     copy: tautologies go, and clauses may be reordered or re-encoded.
+*    --no-reorder     Evaluate the axioms in file order; by default the enumerator
+*                     samples how often each axiom rejects assignments and moves the
+*                     cheap, selective ones first
 */
 
 #include <memory>
 #include <cstdio>
 #include <cstdlib>
+#include <cmath>
 #include <cctype>
 #include <vector>
 #include <string>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <iterator>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <queue>
+#include <functional>
+#include <csignal>
+#if defined(__x86_64__) && !defined(_WIN32)
+#include <sys/mman.h>
+#define HAVE_JIT 1
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#if !defined(_WIN32)
+#include <cerrno>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#define HAVE_DLOPEN 1
+#define HAVE_FORK 1
+#endif
 
 using namespace std;
 
 typedef unsigned long U32;
 typedef unsigned long BOOL;
+typedef unsigned long long U64;
+
+//Bit-sliced evaluation works on blocks of 64 assignments starting at a multiple of 64.
+//Bit i of a block word holds the value for assignment x+i, so the first 6 variables
+//take these fixed patterns and every other variable is constant across the block.
+const U64 blockPatterns[6] =
+{
+    0xAAAAAAAAAAAAAAAAULL, 0xCCCCCCCCCCCCCCCCULL, 0xF0F0F0F0F0F0F0F0ULL,
+    0xFF00FF00FF00FF00ULL, 0xFFFF0000FFFF0000ULL, 0xFFFFFFFF00000000ULL
+};
+
+//64-bit FNV-1a hash, for naming files after their contents
+U64 fnv1a(const string& s, U64 h=0xCBF29CE484222325ULL)
+{
+    for( size_t i=0; i<s.size(); i++ )
+        h = (h^(unsigned char)s[i])*0x100000001B3ULL;
+    return h;
+}
+
+//Compiled propositions: a postfix array with one instruction per node. Instruction i
+//writes slot i and reads its operands from the slots of earlier instructions.
+enum OpCode { OpFalse, OpTrue, OpVar, OpTable, OpNot, OpAnd, OpOr, OpXor, OpImplies, OpIff };
+struct Insn
+{
+    U32 op;
+    U32 a; //Operand slot, variable index for OpVar or table index for OpTable
+    U32 b; //Operand slot
+};
+
+//Truth table of a subformula that depends on few variables above the first 6: the block
+//of the subformula for every combination of those variables
+const U32 TableVars = 6;
+struct Table
+{
+    U32 count;           //Index variables, in increasing order
+    U32 vars[TableVars]; //Bit j of the index is variable vars[j]
+    vector<U64> words;   //Block per index
+    U32 lanes[64];       //Index bits set by variables 6..11 in block k of 64 aligned ones
+    U32 index(U64 x) const
+    {
+        U32 i = 0;
+        for( U32 j=0; j<count; j++ )
+            i |= U32((x>>vars[j]) & 1)<<j;
+        return i;
+    }
+    U64 operator()(U64 x) const { return words[index(x)]; }
+    bool uses(U32 v) const
+    {
+        for( U32 j=0; j<count; j++ )
+            if( vars[j]==v )
+                return true;
+        return false;
+    }
+};
+
+struct Expr;
+struct Program
+{
+    vector<Insn> code;
+    vector<size_t> ends; //Proposition i is computed by code[ends[i-1]..ends[i])
+    vector<U32> roots;   //Slot holding the value of proposition i
+    map<const Expr*,U32> done; //Slot of every node compiled so far
+    vector<Table> tables;
+
+    U32 compile(const shared_ptr<Expr>& e); //Emit a node once, however often it is shared
+
+    U32 emit(U32 op, U32 a=0, U32 b=0)
+    {
+        Insn insn = { op, a, b };
+        code.push_back(insn);
+        return U32(code.size()-1);
+    }
+};
 
 //An Expression Type
 struct Expr
 {
-    virtual BOOL operator()(U32 x) = 0;
+    virtual ~Expr() {}
+    virtual BOOL operator()(U64 x) = 0;
+    virtual U32 compile(Program& p) = 0; //Append postfix code, returns the result slot
 };
 
 //True and False Expressions
 struct True: public Expr
 {
-    BOOL operator()(U32 x) { return BOOL(1); }
+    BOOL operator()(U64 x) { return BOOL(1); }
+    U32 compile(Program& p) { return p.emit(OpTrue); }
 };
 struct False: public Expr
 {
-    BOOL operator()(U32 x) { return BOOL(0); }
+    BOOL operator()(U64 x) { return BOOL(0); }
+    U32 compile(Program& p) { return p.emit(OpFalse); }
 };
 
 //A Variable Expression
 struct Var : public Expr
 {
-    BOOL shift;
-    Var(BOOL shift_in) : shift(shift_in) {};
-    BOOL operator()(U32 x) { return ((x>>shift) & 1); }
+    U32 shift;
+    Var(U32 shift_in) : shift(shift_in) {};
+    BOOL operator()(U64 x) { return ((x>>shift) & 1); }
+    U32 compile(Program& p) { return p.emit(OpVar,shift); }
 };
 
 //A Not Expression
@@ -63,7 +239,8 @@ struct Not : public Expr
 {
     shared_ptr<Expr> E; //Left Expression
     Not(shared_ptr<Expr> E_in) : E(E_in) {};
-    BOOL operator()(U32 x) { return (BOOL(1)^((*E)(x))); }
+    BOOL operator()(U64 x) { return (BOOL(1)^((*E)(x))); }
+    U32 compile(Program& p) { return p.emit(OpNot,p.compile(E)); }
 };
 
 //Various Binary Expressions
@@ -72,260 +249,3507 @@ struct And : public Expr
     shared_ptr<Expr> L; //Left Expression
     shared_ptr<Expr> R; //Right Expression
     And(shared_ptr<Expr> L_in, shared_ptr<Expr> R_in) : L(L_in), R(R_in) {};
-    BOOL operator()(U32 x) { return ((*L)(x)) & ((*R)(x)); }
+    BOOL operator()(U64 x) { return ((*L)(x)) & ((*R)(x)); }
+    U32 compile(Program& p) { U32 l=p.compile(L); return p.emit(OpAnd,l,p.compile(R)); }
 };
 struct Or : public Expr
 {
     shared_ptr<Expr> L; //Left Expression
     shared_ptr<Expr> R; //Right Expression
     Or(shared_ptr<Expr> L_in, shared_ptr<Expr> R_in) : L(L_in), R(R_in) {};
-    BOOL operator()(U32 x) { return ((*L)(x)) | ((*R)(x)); }
+    BOOL operator()(U64 x) { return ((*L)(x)) | ((*R)(x)); }
+    U32 compile(Program& p) { U32 l=p.compile(L); return p.emit(OpOr,l,p.compile(R)); }
 };
 struct Xor : public Expr
 {
     shared_ptr<Expr> L; //Left Expression
     shared_ptr<Expr> R; //Right Expression
     Xor(shared_ptr<Expr> L_in, shared_ptr<Expr> R_in) : L(L_in), R(R_in) {};
-    BOOL operator()(U32 x) { return ((*L)(x)) ^ ((*R)(x)); }
+    BOOL operator()(U64 x) { return ((*L)(x)) ^ ((*R)(x)); }
+    U32 compile(Program& p) { U32 l=p.compile(L); return p.emit(OpXor,l,p.compile(R)); }
 };
 struct Implies : public Expr
 {
     shared_ptr<Expr> L; //Left Expression
     shared_ptr<Expr> R; //Right Expression
     Implies(shared_ptr<Expr> L_in, shared_ptr<Expr> R_in) : L(L_in), R(R_in) {};
-    BOOL operator()(U32 x) { return (BOOL(1))^(((*L)(x)) & ((BOOL(1))^((*R)(x))) ); }
+    BOOL operator()(U64 x) { return (BOOL(1))^(((*L)(x)) & ((BOOL(1))^((*R)(x))) ); }
+    U32 compile(Program& p) { U32 l=p.compile(L); return p.emit(OpImplies,l,p.compile(R)); }
 };
 struct Iff : public Expr
 {
     shared_ptr<Expr> L; //Left Expression
     shared_ptr<Expr> R; //Right Expression
     Iff(shared_ptr<Expr> L_in, shared_ptr<Expr> R_in) : L(L_in), R(R_in) {};
-    BOOL operator()(U32 x) { return ((*L)(x))==((*R)(x)); }
+    BOOL operator()(U64 x) { return ((*L)(x))==((*R)(x)); }
+    U32 compile(Program& p) { U32 l=p.compile(L); return p.emit(OpIff,l,p.compile(R)); }
 };
 
-//Expression Parsing
-U32 parseExpr(const char* s, shared_ptr<Expr>& p);
+U32 Program::compile(const shared_ptr<Expr>& e)
+{
+    map<const Expr*,U32>::iterator it = done.find(e.get());
+    if( it!=done.end() )
+        return it->second;
+    U32 slot = e->compile(*this);
+    done[e.get()] = slot;
+    return slot;
+}
 
-U32 skipWS(const char* s) //skip Whitespace
+//Compile all propositions into one program, the theorem last. Nodes shared with earlier
+//propositions were already computed when a later proposition is evaluated.
+Program compileProgram(const vector<shared_ptr<Expr>>& propositions)
 {
-    const char* e = s;
-    while( isspace(*e) ) e++;
-    return (U32)(e-s);
+    Program p;
+    for( size_t i=0; i<propositions.size(); i++ )
+    {
+        p.roots.push_back(p.compile(propositions[i]));
+        p.ends.push_back(p.code.size());
+    }
+    return p;
 }
 
-U32 parseString(const char* s, const char* str)
+//Rebuilds a program with its propositions computed in the given order, the theorem last.
+//Each proposition brings the nodes of its cone that earlier ones have not computed.
+Program reorderProgram(const Program& p, const vector<U32>& order)
 {
-    const char* e=s;
-    while(*str!='\0' && *e!='\0' && *e==*str)
+    Program q;
+    q.tables = p.tables;
+    vector<U32> slot(p.code.size(),U32(-1));
+    vector<bool> cone(p.code.size());
+    for( size_t i=0; i<order.size(); i++ )
     {
-        e++;
-        str++;
+        U32 root = p.roots[order[i]];
+        fill(cone.begin(),cone.end(),false);
+        cone[root] = true;
+        for( size_t pc=root+1; pc-->0; )
+        {
+            const Insn& c = p.code[pc];
+            if( !cone[pc] || slot[pc]!=U32(-1) )
+                continue;
+            if( c.op>=OpNot )
+                cone[c.a] = true;
+            if( c.op>OpNot )
+                cone[c.b] = true;
+        }
+        for( size_t pc=0; pc<=root; pc++ )
+        {
+            if( !cone[pc] || slot[pc]!=U32(-1) )
+                continue;
+            const Insn& c = p.code[pc];
+            slot[pc] = q.emit(c.op, c.op==OpVar || c.op<OpNot ? c.a : slot[c.a],
+                              c.op>OpNot ? slot[c.b] : 0);
+        }
+        q.roots.push_back(slot[root]);
+        q.ends.push_back(q.code.size());
     }
-    if( *str=='\0' )
-        return U32(e-s);
-    return U32(0);
+    return q;
 }
 
-U32 parseOneString(const char* s, const char* str1, const char* str2)
+//The program runs over a run of W consecutive 64-assignment blocks held in one value
+//of type V, as wide as the vector unit of the host CPU. Slot storage must be aligned
+//to 64 bytes. The body is instantiated once per instruction set from this template.
+#define INLINE inline __attribute__((always_inline))
+
+template<class V, unsigned W> INLINE void varWords(V& v, U64 x, U32 shift)
 {
-    U32 n = parseString(s,str1);
-    if( n )
-        return n;
-    return parseString(s,str2);
+    if( shift<6 )
+    {
+        v = V{} + blockPatterns[shift];
+        return;
+    }
+    U64 t[W];
+    for( unsigned k=0; k<W; k++ )
+        t[k] = U64(0)-U64(((x+64*k)>>shift) & 1);
+    memcpy(&v,t,sizeof(v));
 }
 
-U32 parseTrue(const char* s, shared_ptr<Expr>& p)
+//Looks a table up for the run of W blocks at x, which runs are aligned to
+template<class V, unsigned W> INLINE void tableWords(V& v, U64 x, const Table& t)
 {
-    if( *s=='T' )
+    U32 base = t.index(x);
+    if( !t.count || (U64(1)<<(t.vars[0]-6))>=W ) //Same block for the whole run
     {
-        p = shared_ptr<Expr>(new True);
-        return 1;
+        v = V{} + t.words[base];
+        return;
     }
-    U32 n = parseString(s,"true");
-    if(n)
-        p = shared_ptr<Expr>(new True);
-    return n;
+    U64 w[W];
+    for( unsigned k=0; k<W; k++ )
+        w[k] = t.words[base | t.lanes[k]];
+    memcpy(&v,w,sizeof(v));
 }
 
-U32 parseFalse(const char* s, shared_ptr<Expr>& p)
+template<class V, unsigned W> INLINE bool isZero(const V& v)
 {
-    if( *s=='F' )
+    U64 t[W];
+    memcpy(t,&v,sizeof(v));
+    U64 any = 0;
+    for( unsigned k=0; k<W; k++ )
+        any |= t[k];
+    return !any;
+}
+
+//Evaluates the blocks starting at x. Stores the axioms mask and the theorem value per
+//block, and returns false early once no assignment satisfies the axioms.
+template<class V, unsigned W> INLINE
+bool runProgram(const Program& p, void* scratch, U64 x, U64 valid, U64* axioms, U64* theorem)
+{
+    V* slot = (V*)scratch;
+    const Insn* code = p.code.data();
+    V acc = V{} + valid;
+    size_t pc = 0;
+    for( size_t i=0; i<p.roots.size(); i++ )
     {
-        p = shared_ptr<Expr>(new False);
-        return 1;
+        for( ; pc<p.ends[i]; pc++ )
+        {
+            const Insn& c = code[pc];
+            switch( c.op )
+            {
+            case OpFalse:   slot[pc] = V{}; break;
+            case OpTrue:    slot[pc] = ~V{}; break;
+            case OpVar:     varWords<V,W>(slot[pc],x,c.a); break;
+            case OpTable:   tableWords<V,W>(slot[pc],x,p.tables[c.a]); break;
+            case OpNot:     slot[pc] = ~slot[c.a]; break;
+            case OpAnd:     slot[pc] = slot[c.a] & slot[c.b]; break;
+            case OpOr:      slot[pc] = slot[c.a] | slot[c.b]; break;
+            case OpXor:     slot[pc] = slot[c.a] ^ slot[c.b]; break;
+            case OpImplies: slot[pc] = ~slot[c.a] | slot[c.b]; break;
+            case OpIff:     slot[pc] = ~(slot[c.a] ^ slot[c.b]); break;
+            }
+        }
+        if( i+1<p.roots.size() )
+        {
+            acc &= slot[p.roots[i]];
+            if( isZero<V,W>(acc) )
+                return false;
+        }
     }
-    U32 n = parseString(s,"false");
-    if(n)
-        p = shared_ptr<Expr>(new False);
-    return n;
+    memcpy(axioms,&acc,sizeof(acc));
+    memcpy(theorem,&slot[p.roots.back()],sizeof(acc));
+    return true;
 }
 
-vector<string> variables; //Global for simplicity
-U32 parseVar(const char* s, shared_ptr<Expr>& p)
+//Node-major evaluation: each instruction runs over a tile of TileWords blocks before the
+//next one starts, so dispatch is paid once per 4096 assignments and the inner loops are
+//plain vector code. Instructions write columns of a tile each, and a column is reused
+//once its value is dead, so the scratch stays small enough for L1.
+const unsigned TileWords = 64;
+struct TiledProgram
 {
-    const char* e=s;
-    if( *e!='[' )
-        return U32(0);
-    e++;
-    e+=skipWS(e);
-    char const* startstr = e;
-    while( *e!=']' )
+    vector<Insn> code;    //Operands are columns
+    vector<U32> dest;     //Column written by each instruction
+    vector<size_t> ends;
+    vector<U32> roots;    //Column holding each proposition
+    U32 columns;
+    vector<Table> tables;
+};
+
+TiledProgram tileProgram(const Program& p)
+{
+    TiledProgram t;
+    size_t n = p.code.size();
+    vector<size_t> last(n); //Last instruction reading each value
+    for( size_t pc=0; pc<n; pc++ )
     {
-        if( *e=='\0' )
-            return U32(0);
-        e++;
+        const Insn& c = p.code[pc];
+        last[pc] = pc;
+        if( c.op>=OpNot )
+            last[c.a] = pc;
+        if( c.op>OpNot )
+            last[c.b] = pc;
     }
-    e--;
-    while( isspace(*e) && e > startstr ) e--;
-    e++;
-    string var(startstr,string::size_type(e-startstr));
-    while( *e!=']' ) e++;
-    e++;
+    for( size_t i=0; i<p.roots.size(); i++ ) //Keep roots until the axioms check is done
+        last[p.roots[i]] = max(last[p.roots[i]], i+1<p.roots.size() ? p.ends[i] : n);
+    vector<vector<U32>> dying(n+1);
+    for( size_t pc=0; pc<n; pc++ )
+        dying[last[pc]].push_back(U32(pc));
 
+    vector<U32> col(n), spare;
+    t.columns = 0;
+    for( size_t pc=0; pc<n; pc++ )
     {
-        int i;
-        for(i=0; i<variables.size(); i++)
-            if( variables[i] == var )
-                break;
-        if( i >= variables.size() )
-            variables.push_back(var);
-        if( variables.size() > 32 )
+        Insn c = p.code[pc];
+        if( c.op>=OpNot )
+            c.a = col[c.a];
+        if( c.op>OpNot )
+            c.b = col[c.b];
+        for( size_t k=0; k<dying[pc].size(); k++ )
+            if( dying[pc][k]!=pc )
+                spare.push_back(col[dying[pc][k]]);
+        if( spare.empty() )
+            col[pc] = t.columns++;
+        else
         {
-            printf("error: over 32 propositional variables, Exitting.\n");
-            exit(1);
+            col[pc] = spare.back();
+            spare.pop_back();
         }
-        p = shared_ptr<Expr>(new Var(i));
+        if( last[pc]==pc )
+            spare.push_back(col[pc]);
+        t.code.push_back(c);
+        t.dest.push_back(col[pc]);
     }
-    return U32(e-s);
+    t.ends = p.ends;
+    t.tables = p.tables;
+    for( size_t i=0; i<p.roots.size(); i++ )
+        t.roots.push_back(col[p.roots[i]]);
+    return t;
 }
 
-U32 parseNot(const char* s, shared_ptr<Expr>& p)
+//Evaluates the tile of blocks starting at x with the contract of runProgram
+template<class V, unsigned W> INLINE
+bool runTile(const TiledProgram& p, void* scratch, U64 x, U64 valid, U64* axioms, U64* theorem)
 {
-    const char* e = s;
-    U32 n = parseOneString(s,"!","not");
-    if(n)
+    const unsigned N = TileWords/W;
+    V* column = (V*)scratch;
+    V* acc = column + p.columns*N;
+    for( unsigned k=0; k<N; k++ )
+        acc[k] = V{} + valid;
+    size_t pc = 0;
+    for( size_t i=0; i<p.roots.size(); i++ )
     {
-        e+=n;
-        shared_ptr<Expr> L;
-        n=parseExpr(e,L);
-        if( n )
+        for( ; pc<p.ends[i]; pc++ )
         {
-            e+=n;
-            p=shared_ptr<Expr>(new Not(L));
-            return U32(e-s);
+            const Insn& c = p.code[pc];
+            V* d = column + p.dest[pc]*N;
+            const V* a = column + c.a*N;
+            const V* b = column + c.b*N;
+            switch( c.op )
+            {
+            case OpFalse:   for( unsigned k=0; k<N; k++ ) d[k] = V{}; break;
+            case OpTrue:    for( unsigned k=0; k<N; k++ ) d[k] = ~V{}; break;
+            case OpVar:     for( unsigned k=0; k<N; k++ ) varWords<V,W>(d[k],x+64*W*k,c.a); break;
+            case OpTable:   for( unsigned k=0; k<N; k++ ) tableWords<V,W>(d[k],x+64*W*k,p.tables[c.a]); break;
+            case OpNot:     for( unsigned k=0; k<N; k++ ) d[k] = ~a[k]; break;
+            case OpAnd:     for( unsigned k=0; k<N; k++ ) d[k] = a[k] & b[k]; break;
+            case OpOr:      for( unsigned k=0; k<N; k++ ) d[k] = a[k] | b[k]; break;
+            case OpXor:     for( unsigned k=0; k<N; k++ ) d[k] = a[k] ^ b[k]; break;
+            case OpImplies: for( unsigned k=0; k<N; k++ ) d[k] = ~a[k] | b[k]; break;
+            case OpIff:     for( unsigned k=0; k<N; k++ ) d[k] = ~(a[k] ^ b[k]); break;
+            }
+        }
+        if( i+1<p.roots.size() )
+        {
+            const V* r = column + p.roots[i]*N;
+            V any = V{};
+            for( unsigned k=0; k<N; k++ )
+            {
+                acc[k] &= r[k];
+                any |= acc[k];
+            }
+            if( isZero<V,W>(any) )
+                return false;
         }
     }
-    return 0;
+    memcpy(axioms,acc,TileWords*sizeof(U64));
+    memcpy(theorem,column + p.roots.back()*N,TileWords*sizeof(U64));
+    return true;
 }
 
-U32 parseBinaryExpr(const char* s, shared_ptr<Expr>& p)
+//Evaluates one instruction for the single block at x
+INLINE U64 evalInsn(const Insn& c, const U64* slot, U64 x, const Table* tables)
 {
-    U32 n;
-    const char* e = s;
-    e += skipWS(e);
-    if( *e!='(' )
-        return 0;
-    e++;
-
-    //Parse Left Expression
-    e += skipWS(e);
-    shared_ptr<Expr> L;
-    n = parseExpr(e,L);
-    if(!n)
-        return 0;
-    e += n;
-
-    //Parse Operation String
-    e+=skipWS(e);
-    const char* startop = e;
-    while( *e!='\0' && *e!='!' && *e!='(' && *e!='[' &&
-           *e!='T' && *e!='F' && (*e!='f' || *(e+1)!='a' ) && (*e!='t' || *(e+1)!='r') &&
-           (*e!='n' || *(e+1)!='o') && !isspace(*e) ) e++;
-    string op(startop,e-startop);
-    e+=skipWS(e);
-
-    //Parse Right Expression
-    e += skipWS(e);
-    shared_ptr<Expr> R;
-    n = parseExpr(e,R);
-    if(!n)
-        return 0;
-    e += n;
-
-    //Parse Closing Parenthesis
-    e += skipWS(e);
-    if( *e!=')' )
-        return 0;
-    e++;
-
-    if( op=="and" || op=="&" )
+    switch( c.op )
     {
-        p = shared_ptr<Expr>(new And(L,R));
-        return U32(e-s);
-    }
-    if( op=="or" || op=="|" )
-    {
-        p = shared_ptr<Expr>(new Or(L,R));
-        return U32(e-s);
+    case OpFalse:   return U64(0);
+    case OpTrue:    return ~U64(0);
+    case OpVar:     return c.a<6 ? blockPatterns[c.a] : U64(0)-U64((x>>c.a) & 1);
+    case OpTable:   return tables[c.a](x);
+    case OpNot:     return ~slot[c.a];
+    case OpAnd:     return slot[c.a] & slot[c.b];
+    case OpOr:      return slot[c.a] | slot[c.b];
+    case OpXor:     return slot[c.a] ^ slot[c.b];
+    case OpImplies: return ~slot[c.a] | slot[c.b];
+    case OpIff:     return ~(slot[c.a] ^ slot[c.b]);
     }
-    if( op=="xor" || op=="^" )
+    return U64(0);
+}
+
+//Replaces the largest subformulas that depend on at most TableVars variables above the
+//first 6 with lookup tables, where that saves at least a few instructions, or two for
+//tables of at most 8 blocks, which are cheap to index. A table holds the subformula's
+//block for every combination of those variables, so subformulas over the first 6
+//variables alone become constants. Variables must be below 64.
+Program tabulateProgram(const Program& p)
+{
+    size_t n = p.code.size();
+    vector<U64> high(n); //Variables above the first 6 each node depends on
+    vector<U64> size(n); //Nodes in the tree below each node, shared ones counted again
+    for( size_t pc=0; pc<n; pc++ )
     {
-        p = shared_ptr<Expr>(new Xor(L,R));
-        return U32(e-s);
+        const Insn& c = p.code[pc];
+        high[pc] = c.op==OpVar && c.a>=6 ? U64(1)<<c.a : 0;
+        size[pc] = 1;
+        if( c.op==OpTable )
+            for( U32 j=0; j<p.tables[c.a].count; j++ )
+                high[pc] |= U64(1)<<p.tables[c.a].vars[j];
+        if( c.op>=OpNot )
+        {
+            high[pc] |= high[c.a];
+            size[pc] += size[c.a];
+        }
+        if( c.op>OpNot )
+        {
+            high[pc] |= high[c.b];
+            size[pc] += size[c.b];
+        }
+        size[pc] = min(size[pc],U64(1)<<32);
     }
-    if( op=="then" || op=="implies" || op=="=>" )
+
+    //Walk down from the roots, stopping at the nodes that become tables
+    enum { Unused, Kept, Tabled };
+    vector<char> use(n,Unused);
+    vector<U32> stack(p.roots.begin(),p.roots.end());
+    while( !stack.empty() )
     {
-        p = shared_ptr<Expr>(new Implies(L,R));
-        return U32(e-s);
+        U32 pc = stack.back();
+        stack.pop_back();
+        if( use[pc]!=Unused )
+            continue;
+        const Insn& c = p.code[pc];
+        U32 k = U32(__builtin_popcountll(high[pc]));
+        if( c.op>=OpNot && k<=TableVars && size[pc]>=k+(k<=3 ? 2 : 3) )
+        {
+            use[pc] = Tabled;
+            continue;
+        }
+        use[pc] = Kept;
+        if( c.op>=OpNot )
+            stack.push_back(c.a);
+        if( c.op>OpNot )
+            stack.push_back(c.b);
     }
-    if( op=="if" || op=="<=" )
+
+    Program q;
+    q.tables = p.tables;
+    vector<U32> slot(n);
+    vector<size_t> emitted(n+1,0); //Instructions emitted before each one
+    vector<bool> cone(n);
+    vector<U64> value(n);
+    for( size_t pc=0; pc<n; pc++ )
     {
-        p = shared_ptr<Expr>(new Implies(R,L));
-        return U32(e-s);
+        emitted[pc] = q.code.size();
+        const Insn& c = p.code[pc];
+        if( use[pc]==Kept )
+            slot[pc] = q.emit(c.op, c.op<OpNot ? c.a : slot[c.a], c.op>OpNot ? slot[c.b] : 0);
+        if( use[pc]!=Tabled )
+            continue;
+        Table t;
+        t.count = 0;
+        for( U64 h=high[pc]; h; h&=h-1 )
+            t.vars[t.count++] = U32(__builtin_ctzll(h));
+        for( U32 k=0; k<64; k++ )
+            t.lanes[k] = t.index(U64(k)<<6);
+        fill(cone.begin(),cone.end(),false);
+        cone[pc] = true;
+        for( size_t i=pc+1; i-->0; )
+            if( cone[i] )
+            {
+                if( p.code[i].op>=OpNot )
+                    cone[p.code[i].a] = true;
+                if( p.code[i].op>OpNot )
+                    cone[p.code[i].b] = true;
+            }
+        for( U32 index=0; index<(U32(1)<<t.count); index++ )
+        {
+            U64 x = 0;
+            for( U32 j=0; j<t.count; j++ )
+                x |= U64((index>>j) & 1)<<t.vars[j];
+            for( size_t i=0; i<=pc; i++ )
+                if( cone[i] )
+                    value[i] = evalInsn(p.code[i],value.data(),x,p.tables.data());
+            t.words.push_back(value[pc]);
+        }
+        slot[pc] = q.emit(OpTable,U32(q.tables.size()));
+        q.tables.push_back(t);
     }
-    if( op=="iff" || op=="<=>" )
+    emitted[n] = q.code.size();
+    for( size_t i=0; i<p.roots.size(); i++ )
     {
-        p = shared_ptr<Expr>(new Iff(L,R));
-        return U32(e-s);
+        q.roots.push_back(slot[p.roots[i]]);
+        q.ends.push_back(emitted[p.ends[i]]);
     }
-
-    return 0;
+    return q;
 }
 
-U32 parseExpr(const char* s, shared_ptr<Expr>& p)
+//And-inverter graph: two-input ANDs over complemented edges. A reference is a node index
+//times 2 plus a complement bit; node 0 is false, so reference 0 is false and 1 true.
+//Every AND is hashed by its operands so it exists once, and is simplified on the way in:
+//constants and repeated or opposite operands fold, and so do an operand against the
+//operands of the other when that is an AND (a & (a & b) = a & b, a & !(a & b) = a & !b).
+struct Aig
 {
-    U32 n;
-    const char* e = s;
-    e += skipWS(e);
-    if( n=parseTrue(e,p) )
+    typedef U32 Ref;
+    static const Ref False = 0, True = 1;
+    static const U32 Input = U32(-1); //b of an input node, whose a is its variable
+
+    struct Node
     {
-        e += n;
-        return  U32(e-s);
+        Ref a, b;
+        U32 level; //Longest path to an input
+    };
+
+    vector<Node> nodes;
+    unordered_map<U64,U32> strash;
+    vector<U32> inputs; //Node of each variable, 0 until used
+
+    Aig() { Node constant = { 0, 0, 0 }; nodes.push_back(constant); }
+
+    bool isAnd(Ref r) const { return (r>>1) && nodes[r>>1].b!=Input; }
+    Ref a(Ref r) const { return nodes[r>>1].a; }
+    Ref b(Ref r) const { return nodes[r>>1].b; }
+    U32 level(Ref r) const { return nodes[r>>1].level; }
+
+    Ref var(U32 v)
+    {
+        if( v>=inputs.size() )
+            inputs.resize(v+1,0);
+        if( !inputs[v] )
+        {
+            Node node = { v, Input, 0 };
+            inputs[v] = U32(nodes.size());
+            nodes.push_back(node);
+        }
+        return inputs[v]<<1;
     }
-    if( n=parseFalse(e,p) )
+
+    Ref And(Ref x, Ref y)
     {
-        e += n;
-        return  U32(e-s);
+        if( x>y )
+            swap(x,y);
+        if( x==False || x==(y^1) )
+            return False;
+        if( x==True || x==y )
+            return y;
+        for( int k=0; k<2; k++, swap(x,y) )
+        {
+            if( !isAnd(y) )
+                continue;
+            Ref p = a(y), q = b(y);
+            if( !(y&1) )
+            {
+                if( x==p || x==q )
+                    return y;
+                if( x==(p^1) || x==(q^1) )
+                    return False;
+                if( isAnd(x) && !(x&1) && (a(x)==(p^1) || a(x)==(q^1) || b(x)==(p^1) || b(x)==(q^1)) )
+                    return False;
+            }
+            else
+            {
+                if( x==(p^1) || x==(q^1) )
+                    return x;
+                if( x==p )
+                    return And(x,q^1);
+                if( x==q )
+                    return And(x,p^1);
+            }
+        }
+        if( x>y )
+            swap(x,y);
+        U64 key = U64(x)<<32 | y;
+        unordered_map<U64,U32>::iterator it = strash.find(key);
+        if( it!=strash.end() )
+            return it->second<<1;
+        Node node = { x, y, max(level(x),level(y))+1 };
+        nodes.push_back(node);
+        strash[key] = U32(nodes.size()-1);
+        return (nodes.size()-1)<<1;
     }
-    else if( n=parseVar(e,p) )
+
+    Ref Or(Ref x, Ref y) { return And(x^1,y^1)^1; }
+    Ref Xor(Ref x, Ref y) { return And(And(x,y)^1,And(x^1,y^1)^1); }
+
+    //Drops the nodes made since the graph had size nodes, to undo a trial
+    void truncate(size_t size)
     {
-        e += n;
-        return  U32(e-s);
+        while( nodes.size()>size )
+        {
+            strash.erase(U64(nodes.back().a)<<32 | nodes.back().b);
+            nodes.pop_back();
+        }
     }
-    else if( n=parseNot(e,p) )
+
+    //Fanout of every node reachable from the roots, roots counting once more
+    vector<U32> fanouts(const vector<Ref>& roots) const
     {
-        e += n;
-        return  U32(e-s);
+        vector<U32> fanout(nodes.size(),0);
+        for( size_t i=0; i<roots.size(); i++ )
+            fanout[roots[i]>>1]++;
+        for( size_t n=nodes.size(); n-->1; )
+            if( fanout[n] && nodes[n].b!=Input )
+            {
+                fanout[nodes[n].a>>1]++;
+                fanout[nodes[n].b>>1]++;
+            }
+        return fanout;
     }
-    else if( n=parseBinaryExpr(e,p) )
+};
+
+//Rebuilds every multi-input AND, the tree of ANDs under a node through uncomplemented
+//edges to nodes used nowhere else, by joining its two shallowest operands first.
+//Duplicate operands go, and opposite ones make it false. Drops unreachable nodes.
+Aig balanceAig(const Aig& g, vector<Aig::Ref>& roots)
+{
+    vector<U32> fanout = g.fanouts(roots);
+    vector<bool> absorbed(g.nodes.size(),false); //Part of a larger AND
+    for( size_t n=1; n<g.nodes.size(); n++ )
+        if( fanout[n] && g.nodes[n].b!=Aig::Input )
+        {
+            Aig::Ref ops[] = { g.nodes[n].a, g.nodes[n].b };
+            for( int k=0; k<2; k++ )
+                if( !(ops[k]&1) && g.isAnd(ops[k]) && fanout[ops[k]>>1]==1 )
+                    absorbed[ops[k]>>1] = true;
+        }
+    for( size_t i=0; i<roots.size(); i++ )
+        absorbed[roots[i]>>1] = false;
+
+    Aig h;
+    vector<Aig::Ref> map(g.nodes.size(),Aig::Ref(Aig::False));
+    for( size_t n=1; n<g.nodes.size(); n++ )
     {
-        e += n;
-        return  U32(e-s);
+        if( !fanout[n] || absorbed[n] )
+            continue;
+        if( g.nodes[n].b==Aig::Input )
+        {
+            map[n] = h.var(g.nodes[n].a);
+            continue;
+        }
+        vector<Aig::Ref> leaves, stack(1,Aig::Ref(n<<1));
+        while( !stack.empty() )
+        {
+            Aig::Ref r = stack.back();
+            stack.pop_back();
+            if( r==Aig::Ref(n<<1) || (!(r&1) && absorbed[r>>1]) )
+            {
+                stack.push_back(g.a(r));
+                stack.push_back(g.b(r));
+            }
+            else
+                leaves.push_back(map[r>>1]^(r&1));
+        }
+        sort(leaves.begin(),leaves.end());
+        leaves.erase(unique(leaves.begin(),leaves.end()),leaves.end());
+        bool opposite = false;
+        for( size_t i=1; i<leaves.size(); i++ )
+            opposite |= leaves[i]==(leaves[i-1]^1);
+        if( opposite )
+        {
+            map[n] = Aig::False;
+            continue;
+        }
+        typedef pair<U32,Aig::Ref> Operand; //Level first, shallowest on top
+        priority_queue<Operand,vector<Operand>,greater<Operand>> queue;
+        for( size_t i=0; i<leaves.size(); i++ )
+            queue.push(Operand(h.level(leaves[i]),leaves[i]));
+        while( queue.size()>1 )
+        {
+            Aig::Ref x = queue.top().second;
+            queue.pop();
+            Aig::Ref y = queue.top().second;
+            queue.pop();
+            Aig::Ref r = h.And(x,y);
+            queue.push(Operand(h.level(r),r));
+        }
+        map[n] = queue.top().second;
     }
-    return 0;
+    for( size_t i=0; i<roots.size(); i++ )
+        roots[i] = map[roots[i]>>1]^(roots[i]&1);
+    return h;
 }
 
-U32 parseTopLevelExpr(const char* s, shared_ptr<Expr>& p)
+//Truth tables over the 4 leaves of a cut, one bit per combination
+typedef U32 Truth4;
+const Truth4 LeafTruth[4] = { 0xAAAA, 0xCCCC, 0xF0F0, 0xFF00 };
+INLINE Truth4 cofactor0(Truth4 t, int v) { t &= ~LeafTruth[v] & 0xFFFF; return t | t<<(1<<v); }
+INLINE Truth4 cofactor1(Truth4 t, int v) { t &= LeafTruth[v]; return t | t>>(1<<v); }
+
+//Factors a function of the cut leaves into the graph: an AND, OR or XOR with a leaf
+//where one cofactor allows it, otherwise a multiplexer on the leaf whose cofactors have
+//the fewest leaves left
+Aig::Ref synthesize(Aig& h, Truth4 t, const Aig::Ref* leaf)
+{
+    if( t==0 )
+        return Aig::False;
+    if( t==0xFFFF )
+        return Aig::True;
+    int best = -1, bestSupport = 9;
+    for( int v=0; v<4; v++ )
+    {
+        Truth4 t0 = cofactor0(t,v), t1 = cofactor1(t,v);
+        if( t0==t1 )
+            continue;
+        if( t0==0 )
+            return h.And(leaf[v],synthesize(h,t1,leaf));
+        if( t1==0 )
+            return h.And(leaf[v]^1,synthesize(h,t0,leaf));
+        if( t0==0xFFFF )
+            return h.Or(leaf[v]^1,synthesize(h,t1,leaf));
+        if( t1==0xFFFF )
+            return h.Or(leaf[v],synthesize(h,t0,leaf));
+        if( t0==(t1^0xFFFF) )
+            return h.Xor(leaf[v],synthesize(h,t0,leaf));
+        int support = 0;
+        for( int u=0; u<4; u++ )
+            support += (cofactor0(t0,u)!=cofactor1(t0,u)) + (cofactor0(t1,u)!=cofactor1(t1,u));
+        if( support<bestSupport )
+            best = v, bestSupport = support;
+    }
+    Aig::Ref s0 = synthesize(h,cofactor0(t,best),leaf);
+    Aig::Ref s1 = synthesize(h,cofactor1(t,best),leaf);
+    return h.Or(h.And(leaf[best],s1),h.And(leaf[best]^1,s0));
+}
+
+//DAG-aware rewriting over 4-input cuts, rebuilding the graph in topological order. Each
+//node's cuts come from merging its operands' cuts, at most 8 of them, with their truth
+//tables. For each cut the node's function is factored again over the rebuilt leaves, and
+//the cheapest one is kept if it needs fewer new nodes than the node's maximum fanout-free
+//cone inside the cut, which the old structure would keep alive. Nodes of that cone that
+//the new structure reuses still count as new.
+Aig rewriteAig(const Aig& g, vector<Aig::Ref>& roots)
+{
+    struct Cut
+    {
+        U32 leaves[4];
+        U32 size;
+        Truth4 truth;
+    };
+    const size_t MaxCuts = 8;
+    vector<U32> fanout = g.fanouts(roots);
+    vector<vector<Cut>> cuts(g.nodes.size());
+    Aig h;
+    vector<Aig::Ref> map(g.nodes.size(),Aig::Ref(Aig::False));
+    vector<U32> stamp, cone; //Rebuilt nodes of the cone being replaced, marked by node
+    U32 now = 0;
+    for( size_t n=1; n<g.nodes.size(); n++ )
+    {
+        if( !fanout[n] )
+            continue;
+        Cut self = { { U32(n) }, 1, LeafTruth[0] };
+        if( g.nodes[n].b==Aig::Input )
+        {
+            map[n] = h.var(g.nodes[n].a);
+            cuts[n].push_back(self);
+            continue;
+        }
+
+        //Merge the operands' cuts, after the trivial one
+        Aig::Ref ops[] = { g.nodes[n].a, g.nodes[n].b };
+        vector<Cut>& mine = cuts[n];
+        mine.push_back(self);
+        const vector<Cut>& ca = cuts[ops[0]>>1];
+        const vector<Cut>& cb = cuts[ops[1]>>1];
+        for( size_t i=0; i<ca.size(); i++ )
+            for( size_t j=0; j<cb.size() && mine.size()<=MaxCuts; j++ )
+            {
+                Cut c;
+                vector<U32> merged;
+                set_union(ca[i].leaves,ca[i].leaves+ca[i].size,cb[j].leaves,
+                          cb[j].leaves+cb[j].size,back_inserter(merged));
+                if( merged.size()>4 )
+                    continue;
+                c.size = U32(merged.size());
+                copy(merged.begin(),merged.end(),c.leaves);
+                //Each operand's table, with its leaves moved to their places in c
+                Truth4 t[2];
+                const Cut* from[] = { &ca[i], &cb[j] };
+                for( int k=0; k<2; k++ )
+                {
+                    t[k] = 0;
+                    for( U32 m=0; m<16; m++ )
+                    {
+                        U32 index = 0;
+                        for( U32 l=0; l<from[k]->size; l++ )
+                        {
+                            U32 at = U32(find(c.leaves,c.leaves+c.size,from[k]->leaves[l])-c.leaves);
+                            index |= ((m>>at)&1)<<l;
+                        }
+                        t[k] |= ((from[k]->truth>>index)&1)<<m;
+                    }
+                    if( ops[k]&1 )
+                        t[k] ^= 0xFFFF;
+                }
+                c.truth = t[0] & t[1];
+                bool dominated = false;
+                for( size_t d=0; d<mine.size() && !dominated; d++ )
+                    dominated = includes(c.leaves,c.leaves+c.size,mine[d].leaves,
+                                         mine[d].leaves+mine[d].size);
+                if( !dominated )
+                    mine.push_back(c);
+            }
+
+        //Try each cut of 3 or 4 leaves, both polarities
+        Aig::Ref plain = h.And(map[ops[0]>>1]^(ops[0]&1),map[ops[1]>>1]^(ops[1]&1));
+        size_t base = h.nodes.size();
+        int bestCut = -1, bestPolarity = 0;
+        U32 bestCost = 0;
+        for( size_t i=0; i<mine.size(); i++ )
+        {
+            const Cut& c = mine[i];
+            if( c.size<3 )
+                continue;
+            //The cone: nodes below n, down to the leaves, used only inside it
+            now++;
+            if( stamp.size()<h.nodes.size() )
+                stamp.resize(h.nodes.size(),0);
+            U32 saved = 1;
+            vector<U32> stack(1,U32(n)), touched;
+            while( !stack.empty() )
+            {
+                U32 m = stack.back();
+                stack.pop_back();
+                Aig::Ref children[] = { g.nodes[m].a, g.nodes[m].b };
+                for( int k=0; k<2; k++ )
+                {
+                    U32 child = children[k]>>1;
+                    if( find(c.leaves,c.leaves+c.size,child)!=c.leaves+c.size )
+                        continue;
+                    touched.push_back(child);
+                    if( --fanout[child]==0 )
+                    {
+                        saved++;
+                        stamp[map[child]>>1] = now;
+                        stack.push_back(child);
+                    }
+                }
+            }
+            for( size_t k=0; k<touched.size(); k++ )
+                fanout[touched[k]]++;
+            stamp[plain>>1] = now;
+
+            Aig::Ref leaf[4];
+            for( U32 l=0; l<c.size; l++ )
+                leaf[l] = map[c.leaves[l]];
+            for( int polarity=0; polarity<2; polarity++ )
+            {
+                Aig::Ref r = synthesize(h,polarity ? c.truth^0xFFFF : c.truth,leaf);
+                //New nodes and reused ones of the cone under r, down to the leaves
+                U32 cost = 0;
+                vector<Aig::Ref> walk(1,r);
+                vector<U32> seen;
+                while( !walk.empty() )
+                {
+                    U32 m = walk.back()>>1;
+                    walk.pop_back();
+                    if( !h.isAnd(m<<1) || find(seen.begin(),seen.end(),m)!=seen.end() )
+                        continue;
+                    if( m<base && (m>=stamp.size() || stamp[m]!=now) )
+                        continue;
+                    seen.push_back(m);
+                    cost++;
+                    walk.push_back(h.nodes[m].a);
+                    walk.push_back(h.nodes[m].b);
+                }
+                h.truncate(base);
+                if( cost<saved && (bestCut<0 || cost<bestCost) )
+                    bestCut = int(i), bestPolarity = polarity, bestCost = cost;
+            }
+        }
+        if( bestCut<0 )
+        {
+            map[n] = plain;
+            continue;
+        }
+        const Cut& c = mine[bestCut];
+        Aig::Ref leaf[4];
+        for( U32 l=0; l<c.size; l++ )
+            leaf[l] = map[c.leaves[l]];
+        map[n] = synthesize(h,bestPolarity ? c.truth^0xFFFF : c.truth,leaf)^bestPolarity;
+    }
+    for( size_t i=0; i<roots.size(); i++ )
+        roots[i] = map[roots[i]>>1]^(roots[i]&1);
+    return h;
+}
+
+//Writes an AIG back as a program, each proposition after the last, computing every
+//reference it needs once. Operators come back where their ANDs show them: the three ANDs
+//of an XOR or IFF become one instruction, and a complemented AND an OR or implication.
+//Every reference has an estimated cost, its instructions counted as if nothing were
+//shared, and each gate takes the form whose operands are cheapest, already emitted ones
+//being free, so negations go where they are needed.
+struct AigEmitter
+{
+    const Aig& g;
+    Program q;
+    vector<U32> slot; //Per reference, NoSlot until emitted
+    vector<U64> cost; //Per reference
+    static const U32 NoSlot = U32(-1);
+
+    AigEmitter(const Aig& aig) : g(aig), slot(2*aig.nodes.size(),U32(-1)),
+        cost(2*aig.nodes.size(),1)
+    {
+        const U64 Most = U64(1)<<40;
+        for( size_t n=1; n<g.nodes.size(); n++ )
+        {
+            Aig::Ref r = Aig::Ref(n<<1), x = g.nodes[n].a, y = g.nodes[n].b, u, v;
+            U64 pos, neg;
+            if( y==Aig::Input )
+                pos = 1, neg = 2;
+            else if( isXor(n,u,v) )
+                pos = neg = 1+min(min(cost[u]+cost[v],cost[u^1]+cost[v^1]),
+                                  min(cost[u^1]+cost[v],cost[u]+cost[v^1]));
+            else
+            {
+                pos = 1+cost[x]+cost[y];
+                neg = 1+min(cost[x^1]+cost[y^1],min(cost[x]+cost[y^1],cost[x^1]+cost[y]));
+                pos = min(pos,neg+1);
+                neg = min(neg,pos+1);
+            }
+            cost[r] = min(pos,Most);
+            cost[r^1] = min(neg,Most);
+        }
+    }
+
+    //Whether node n is (u xor v), for references u and v
+    bool isXor(size_t n, Aig::Ref& u, Aig::Ref& v) const
+    {
+        Aig::Ref x = g.nodes[n].a, y = g.nodes[n].b;
+        if( !(x&1) || !(y&1) || !g.isAnd(x) || !g.isAnd(y) )
+            return false;
+        u = g.a(x);
+        v = g.b(x);
+        Aig::Ref p = g.a(y), r = g.b(y);
+        return (p==(u^1) && r==(v^1)) || (p==(v^1) && r==(u^1));
+    }
+
+    U64 price(Aig::Ref r) const { return slot[r]!=NoSlot ? 0 : cost[r]; }
+
+    //The slot of r, not as the negation of the opposite reference when direct
+    U32 emit(Aig::Ref r, bool direct=false)
+    {
+        if( slot[r]!=NoSlot )
+            return slot[r];
+        U32 s, n = U32(r>>1);
+        Aig::Ref u, v, x = g.nodes[n].a, y = g.nodes[n].b;
+        if( !n )
+            s = q.emit(r ? OpTrue : OpFalse);
+        else if( y==Aig::Input )
+            s = r&1 ? q.emit(OpNot,emit(r^1)) : q.emit(OpVar,x);
+        else if( isXor(n,u,v) )
+        {
+            //u^v with either operand complemented, the operator making up for it
+            Aig::Ref bu = u, bv = v;
+            for( int k=1; k<4; k++ )
+                if( price(u^(k&1))+price(v^(k>>1)) < price(bu)+price(bv) )
+                    bu = u^(k&1), bv = v^(k>>1);
+            U32 su = emit(bu), sv = emit(bv);
+            s = q.emit((bu^bv^u^v^r)&1 ? OpIff : OpXor,su,sv);
+        }
+        else
+        {
+            //Candidate forms: operands and operator, or a negation of the other polarity
+            Aig::Ref forms[3][2] = { { x^1, y^1 }, { x, y^1 }, { y, x^1 } };
+            int best = -1;
+            U64 bestPrice = direct ? ~U64(0) : 1+price(r^1);
+            if( !(r&1) && price(x)+price(y) < bestPrice )
+                best = 0, bestPrice = price(x)+price(y);
+            for( int k=0; k<3 && (r&1); k++ )
+                if( price(forms[k][0])+price(forms[k][1]) < bestPrice )
+                    best = k, bestPrice = price(forms[k][0])+price(forms[k][1]);
+            if( best<0 )
+                s = q.emit(OpNot,emit(r^1,true));
+            else if( !(r&1) )
+            {
+                U32 sx = emit(x), sy = emit(y);
+                s = q.emit(OpAnd,sx,sy);
+            }
+            else
+            {
+                U32 sa = emit(forms[best][0]), sb = emit(forms[best][1]);
+                s = q.emit(best ? OpImplies : OpOr,sa,sb);
+            }
+        }
+        return slot[r] = s;
+    }
+};
+
+//Optimizes a program through an AIG: hashed and simplified on the way in, then balanced,
+//rewritten and balanced again. Keeps the program if that does not make it smaller.
+Program optimizeProgram(const Program& p)
+{
+    Aig g;
+    vector<Aig::Ref> ref(p.code.size());
+    for( size_t pc=0; pc<p.code.size(); pc++ )
+    {
+        const Insn& c = p.code[pc];
+        Aig::Ref a = c.op>=OpNot ? ref[c.a] : 0, b = c.op>OpNot ? ref[c.b] : 0;
+        switch( c.op )
+        {
+        case OpFalse: ref[pc] = Aig::False; break;
+        case OpTrue: ref[pc] = Aig::True; break;
+        case OpVar: ref[pc] = g.var(c.a); break;
+        case OpNot: ref[pc] = a^1; break;
+        case OpAnd: ref[pc] = g.And(a,b); break;
+        case OpOr: ref[pc] = g.Or(a,b); break;
+        case OpImplies: ref[pc] = g.Or(a^1,b); break;
+        case OpXor: ref[pc] = g.Xor(a,b); break;
+        case OpIff: ref[pc] = g.Xor(a,b)^1; break;
+        default: return p; //Tables are made later
+        }
+    }
+    vector<Aig::Ref> roots;
+    for( size_t i=0; i<p.roots.size(); i++ )
+        roots.push_back(ref[p.roots[i]]);
+    Aig h = balanceAig(g,roots);
+    h = rewriteAig(h,roots);
+    h = balanceAig(h,roots);
+
+    AigEmitter out(h);
+    for( size_t i=0; i<roots.size(); i++ )
+    {
+        out.q.roots.push_back(out.emit(roots[i]));
+        out.q.ends.push_back(out.q.code.size());
+    }
+    return out.q.code.size()<p.code.size() ? out.q : p;
+}
+
+typedef U64 V4 __attribute__((vector_size(32)));
+typedef U64 V8 __attribute__((vector_size(64)));
+const unsigned MaxWideWords = 8;
+
+//One instruction set the program can run with
+struct Isa
+{
+    const char* name;
+    unsigned words; //Blocks per run
+    bool (*run)(const Program& p, void* scratch, U64 x, U64 valid, U64* axioms, U64* theorem);
+    bool (*tile)(const TiledProgram& p, void* scratch, U64 x, U64 valid, U64* axioms, U64* theorem);
+};
+
+bool runScalar(const Program& p, void* scratch, U64 x, U64 valid, U64* axioms, U64* theorem)
+{
+    return runProgram<U64,1>(p,scratch,x,valid,axioms,theorem);
+}
+bool runGeneric(const Program& p, void* scratch, U64 x, U64 valid, U64* axioms, U64* theorem)
+{
+    return runProgram<V4,4>(p,scratch,x,valid,axioms,theorem);
+}
+bool tileScalar(const TiledProgram& p, void* scratch, U64 x, U64 valid, U64* axioms, U64* theorem)
+{
+    return runTile<U64,1>(p,scratch,x,valid,axioms,theorem);
+}
+bool tileGeneric(const TiledProgram& p, void* scratch, U64 x, U64 valid, U64* axioms, U64* theorem)
+{
+    return runTile<V4,4>(p,scratch,x,valid,axioms,theorem);
+}
+const Isa scalarIsa = { "scalar", 1, runScalar, tileScalar };
+const Isa genericIsa = { "generic", 4, runGeneric, tileGeneric };
+
+#if defined(__x86_64__) || defined(__i386__)
+//AVX2: 256 assignments per operation
+__attribute__((target("avx2")))
+bool runAvx2(const Program& p, void* scratch, U64 x, U64 valid, U64* axioms, U64* theorem)
+{
+    return runProgram<V4,4>(p,scratch,x,valid,axioms,theorem);
+}
+__attribute__((target("avx2")))
+bool tileAvx2(const TiledProgram& p, void* scratch, U64 x, U64 valid, U64* axioms, U64* theorem)
+{
+    return runTile<V4,4>(p,scratch,x,valid,axioms,theorem);
+}
+const Isa avx2Isa = { "avx2", 4, runAvx2, tileAvx2 };
+
+//AVX-512: 512 assignments per operation, implies/iff fold into ternary-logic instructions
+__attribute__((target("avx512f")))
+bool runAvx512(const Program& p, void* scratch, U64 x, U64 valid, U64* axioms, U64* theorem)
+{
+    return runProgram<V8,8>(p,scratch,x,valid,axioms,theorem);
+}
+__attribute__((target("avx512f")))
+bool tileAvx512(const TiledProgram& p, void* scratch, U64 x, U64 valid, U64* axioms, U64* theorem)
+{
+    return runTile<V8,8>(p,scratch,x,valid,axioms,theorem);
+}
+const Isa avx512Isa = { "avx512", 8, runAvx512, tileAvx512 };
+#endif
+
+//Pick an instruction set by name, or the widest the CPU supports when name is null
+const Isa* selectIsa(const char* name)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    bool has512 = __builtin_cpu_supports("avx512f");
+    bool has2 = __builtin_cpu_supports("avx2");
+    if( !name )
+        return has512 ? &avx512Isa : has2 ? &avx2Isa : &genericIsa;
+    if( string(name)=="avx512" )
+        return has512 ? &avx512Isa : 0;
+    if( string(name)=="avx2" )
+        return has2 ? &avx2Isa : 0;
+#endif
+    if( !name || string(name)=="generic" )
+        return &genericIsa;
+    return 0;
+}
+
+//Evaluates runs of consecutive blocks for the enumerator, with the contract of runProgram
+struct Evaluator
+{
+    unsigned words; //Blocks per run
+    virtual ~Evaluator() {}
+    virtual bool run(U64 x, U64 valid, U64* axioms, U64* theorem) = 0;
+
+    //Scans blocks [begin,end) for the smallest counterexample, noting whether any
+    //assignment satisfied the axioms. begin must be a multiple of words.
+    virtual bool scan(U64 begin, U64 end, U64 valid, bool& consistent, U64& cex)
+    {
+        for( U64 b=begin; b<end; b+=words )
+        {
+            U64 axioms[TileWords]; //No evaluator runs more blocks than a tile
+            U64 value[TileWords];
+            if( !run(b*64,valid,axioms,value) ) //axioms not satisfied
+                continue;
+            consistent = true;
+            for( unsigned k=0; k<words; k++ )
+            {
+                U64 bad = axioms[k] & ~value[k];
+                if( bad ) //theorem not satisfied
+                {
+                    cex = (b+k)*64 + __builtin_ctzll(bad);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+};
+
+//Orders the axioms of a program so the cheapest, most selective ones run first and the
+//early exit comes sooner. Every 1024th block is evaluated in full and each axiom's
+//rejections are counted. After 16 samples, then after twice as many each time up
+//to 1024, the axioms are sorted by cost (nodes in the cone) over rejection rate and the
+//counts are halved to follow the sweep. The new order is taken when it promises to
+//evaluate at least 10% fewer nodes.
+struct AxiomOrder
+{
+    Program original;
+    vector<U32> order;     //Propositions in evaluation order, the theorem last
+    vector<U64> cost;      //Nodes in the cone of each axiom
+    vector<U64> rejected;  //Assignments each axiom rejected in the samples
+    vector<U64> slots;
+    U64 seen;              //Assignments in the samples
+    U32 samples;
+    U32 window;            //Samples between reorderings
+    bool enabled;
+
+    AxiomOrder(const Program& p, bool enable) : original(p), order(p.roots.size()),
+        cost(p.roots.size()), rejected(p.roots.size()), seen(0), samples(0),
+        window(16),
+        enabled(enable && p.roots.size()>2)
+    {
+        for( size_t i=0; i<order.size(); i++ )
+            order[i] = U32(i);
+        if( !enabled )
+            return;
+        slots.resize(p.code.size());
+        vector<bool> cone(p.code.size());
+        for( size_t i=0; i+1<p.roots.size(); i++ )
+        {
+            fill(cone.begin(),cone.end(),false);
+            cone[p.roots[i]] = true;
+            for( size_t pc=p.roots[i]+1; pc-->0; )
+            {
+                const Insn& c = p.code[pc];
+                if( !cone[pc] )
+                    continue;
+                cost[i]++;
+                if( c.op>=OpNot )
+                    cone[c.a] = true;
+                if( c.op>OpNot )
+                    cone[c.b] = true;
+            }
+        }
+    }
+
+    //Notes a run starting at x; returns true with a new order to evaluate in
+    bool sample(U64 x, U64 valid)
+    {
+        if( !enabled || ((x>>6) & 1023) )
+            return false;
+        const Program& p = original;
+        for( size_t pc=0; pc<p.code.size(); pc++ )
+            slots[pc] = evalInsn(p.code[pc],slots.data(),x,p.tables.data());
+        for( size_t i=0; i+1<p.roots.size(); i++ )
+            rejected[i] += __builtin_popcountll(valid & ~slots[p.roots[i]]);
+        seen += __builtin_popcountll(valid);
+        if( ++samples<window )
+            return false;
+        samples = 0;
+        window = min(2*window,U32(1024));
+        vector<U32> sorted(order.begin(),order.end()-1);
+        stable_sort(sorted.begin(),sorted.end(),Cheaper(*this));
+        sorted.push_back(order.back());
+        bool better = expectedCost(sorted) < 0.9*expectedCost(order);
+        for( size_t i=0; i<rejected.size(); i++ )
+            rejected[i] /= 2;
+        seen /= 2;
+        if( !better )
+            return false;
+        order.swap(sorted);
+        return true;
+    }
+
+    //Nodes evaluated per assignment in an order, if the axioms reject independently
+    double expectedCost(const vector<U32>& o) const
+    {
+        double nodes = 0, pass = 1;
+        for( size_t i=0; i+1<o.size(); i++ )
+        {
+            nodes += pass*cost[o[i]];
+            pass *= 1 - double(rejected[o[i]])/max(seen,U64(1));
+        }
+        return nodes;
+    }
+
+    Program program() const { return reorderProgram(original,order); }
+
+    struct Cheaper
+    {
+        const AxiomOrder& o;
+        Cheaper(const AxiomOrder& o_in) : o(o_in) {}
+        bool operator()(U32 a, U32 b) const
+        {
+            return double(o.cost[a])*(o.rejected[b]+1) < double(o.cost[b])*(o.rejected[a]+1);
+        }
+    };
+};
+
+//Runs the program on the bytecode VM
+struct VmEvaluator : public Evaluator
+{
+    Program program;
+    const Isa* isa;
+    AxiomOrder order;
+    vector<U64> slots;
+    void* scratch;
+    VmEvaluator(const Program& p, const Isa* isa_in, bool reorder) : program(p), isa(isa_in),
+        order(p,reorder), slots(p.code.size()*MaxWideWords+MaxWideWords)
+    {
+        words = isa->words;
+        scratch = (void*)((size_t(slots.data())+63) & ~size_t(63));
+    }
+    bool run(U64 x, U64 valid, U64* axioms, U64* theorem)
+    {
+        if( order.sample(x,valid) )
+            program = order.program();
+        return isa->run(program,scratch,x,valid,axioms,theorem);
+    }
+};
+
+//Runs the program node by node over tiles of TileWords blocks
+struct TileEvaluator : public Evaluator
+{
+    TiledProgram program;
+    const Isa* isa;
+    AxiomOrder order;
+    vector<U64> slots;
+    void* scratch;
+    TileEvaluator(const Program& p, const Isa* isa_in, bool reorder) : isa(isa_in), order(p,reorder)
+    {
+        words = TileWords;
+        load(p);
+    }
+    void load(const Program& p)
+    {
+        program = tileProgram(p);
+        slots.resize((program.columns+1)*TileWords+8); //Columns and the axioms mask
+        scratch = (void*)((size_t(slots.data())+63) & ~size_t(63));
+    }
+    bool run(U64 x, U64 valid, U64* axioms, U64* theorem)
+    {
+        if( order.sample(x,valid) )
+            load(order.program());
+        return isa->tile(program,scratch,x,valid,axioms,theorem);
+    }
+};
+
+#ifdef HAVE_JIT
+//Translates the program into straight-line x86-64 code for one block per call:
+//    int f(U64 x [rdi], U64* slots [rsi], U64 valid [rdx], U64* out [rcx])
+//Values are computed in rax and kept in slots for later operands, the running axioms
+//mask lives in r8, and the code returns 0 as soon as that mask becomes zero.
+struct JitEvaluator : public Evaluator
+{
+    vector<unsigned char> buf;
+    vector<size_t> exits; //rel32 fields jumping to the early exit
+    void* code;
+    size_t size;
+    vector<U64> slots;
+
+    void byte(unsigned b) { buf.push_back((unsigned char)b); }
+    void bytes(const char* s, size_t n) { buf.insert(buf.end(),s,s+n); }
+    void imm32(U32 v) { for( int i=0; i<4; i++ ) byte((v>>(8*i)) & 0xFF); }
+    void rmSlot(const char* op, U32 slot) { bytes(op,3); imm32(slot*8); } //op reg,[rsi+slot*8]
+
+    vector<Table> tables; //Read by the code; reordering keeps the tables
+    AxiomOrder order;
+
+    JitEvaluator(const Program& p, bool reorder) : code(0), size(0), slots(p.code.size()),
+        tables(p.tables), order(p,reorder)
+    {
+        words = 1;
+        build(p);
+    }
+
+    //Generates the code for p; the earlier code is kept if that fails
+    void build(const Program& p)
+    {
+        buf.clear();
+        exits.clear();
+        bytes("\x49\x89\xD0",3);                                //mov r8,rdx
+        size_t pc = 0;
+        U32 inRax = U32(-1);                                    //Slot currently held in rax
+        for( size_t i=0; i<p.roots.size(); i++ )
+        {
+            for( ; pc<p.ends[i]; pc++ )
+            {
+                const Insn& c = p.code[pc];
+                if( c.op>=OpNot && c.a!=inRax )
+                    rmSlot("\x48\x8B\x86",c.a);                 //mov rax,[a]
+                switch( c.op )
+                {
+                case OpFalse: bytes("\x31\xC0",2); break;       //xor eax,eax
+                case OpTrue: bytes("\x48\xC7\xC0\xFF\xFF\xFF\xFF",7); break; //mov rax,-1
+                case OpVar:
+                    if( c.a<6 )
+                    {
+                        bytes("\x48\xB8",2);                    //movabs rax,pattern
+                        imm32(U32(blockPatterns[c.a]));
+                        imm32(U32(blockPatterns[c.a]>>32));
+                    }
+                    else
+                    {
+                        bytes("\x48\x89\xF8",3);                //mov rax,rdi
+                        bytes("\x48\xC1\xE8",3); byte(c.a);     //shr rax,shift
+                        bytes("\x83\xE0\x01",3);                //and eax,1
+                        bytes("\x48\xF7\xD8",3);                //neg rax
+                    }
+                    break;
+                case OpTable:
+                {
+                    const Table& t = tables[c.a];
+                    bytes("\x31\xD2",2);                        //xor edx,edx
+                    for( U32 j=t.count; j-->0; )
+                    {
+                        bytes("\x48\x0F\xBA\xE7",4); byte(t.vars[j]); //bt rdi,var
+                        bytes("\x11\xD2",2);                    //adc edx,edx
+                    }
+                    U64 words = U64(size_t(t.words.data()));
+                    bytes("\x48\xB8",2);                        //movabs rax,words
+                    imm32(U32(words));
+                    imm32(U32(words>>32));
+                    bytes("\x48\x8B\x04\xD0",4);                //mov rax,[rax+rdx*8]
+                    break;
+                }
+                case OpNot: bytes("\x48\xF7\xD0",3); break;    //not rax
+                case OpAnd: rmSlot("\x48\x23\x86",c.b); break;  //and rax,[b]
+                case OpOr: rmSlot("\x48\x0B\x86",c.b); break;   //or rax,[b]
+                case OpXor: rmSlot("\x48\x33\x86",c.b); break;  //xor rax,[b]
+                case OpImplies:
+                    bytes("\x48\xF7\xD0",3);                    //not rax
+                    rmSlot("\x48\x0B\x86",c.b);                 //or rax,[b]
+                    break;
+                case OpIff:
+                    rmSlot("\x48\x33\x86",c.b);                 //xor rax,[b]
+                    bytes("\x48\xF7\xD0",3);                    //not rax
+                    break;
+                }
+                rmSlot("\x48\x89\x86",U32(pc));                 //mov [pc],rax
+                inRax = U32(pc);
+            }
+            if( i+1<p.roots.size() )
+            {
+                rmSlot("\x4C\x23\x86",p.roots[i]);              //and r8,[root]
+                bytes("\x0F\x84",2);                            //jz exit
+                exits.push_back(buf.size());
+                imm32(0);
+            }
+        }
+        bytes("\x4C\x89\x01",3);                                //mov [rcx],r8
+        rmSlot("\x48\x8B\x86",p.roots.back());                  //mov rax,[theorem]
+        bytes("\x48\x89\x41\x08",4);                            //mov [rcx+8],rax
+        bytes("\xB8\x01\x00\x00\x00",5);                        //mov eax,1
+        byte(0xC3);                                             //ret
+        for( size_t i=0; i<exits.size(); i++ )
+        {
+            U32 rel = U32(buf.size()-(exits[i]+4));
+            memcpy(&buf[exits[i]],&rel,4);
+        }
+        bytes("\x31\xC0",2);                                    //exit: xor eax,eax
+        byte(0xC3);                                             //ret
+
+        void* m = mmap(0,buf.size(),PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+        if( m==MAP_FAILED )
+            return;
+        memcpy(m,buf.data(),buf.size());
+        if( mprotect(m,buf.size(),PROT_READ|PROT_EXEC) )
+        {
+            munmap(m,buf.size());
+            return;
+        }
+        if( code )
+            munmap(code,size);
+        code = m;
+        size = buf.size();
+    }
+    ~JitEvaluator()
+    {
+        if( code )
+            munmap(code,size);
+    }
+    bool run(U64 x, U64 valid, U64* axioms, U64* theorem)
+    {
+        U64 out[2];
+        if( order.sample(x,valid) )
+            build(order.program());
+        if( !((int(*)(U64,U64*,U64,U64*))code)(x,slots.data(),valid,out) )
+            return false;
+        axioms[0] = out[0];
+        theorem[0] = out[1];
+        return true;
+    }
+};
+#endif
+
+#ifdef HAVE_DLOPEN
+//Emits the program as C with one local per node, builds it as a shared object with the
+//system compiler and loads it. The object is cached under a hash of its source, so
+//reruns on the same problem skip the compiler. Runs cover 8 blocks as one GCC vector.
+typedef int (*NativeRun)(U64 x, U64 valid, U64* axioms, U64* theorem);
+
+string emitNative(const Program& p, const char* fn, const char* type, unsigned w)
+{
+    string src = string("int ")+fn+"(u64 x, u64 valid, u64* axioms, u64* theorem)\n{\n";
+    src += string("    ")+type+" acc = ("+type+"){0} + valid;\n";
+    char buf[256];
+    size_t pc = 0;
+    for( size_t i=0; i<p.roots.size(); i++ )
+    {
+        for( ; pc<p.ends[i]; pc++ )
+        {
+            const Insn& c = p.code[pc];
+            snprintf(buf,sizeof(buf),"    %s n%lu = ",type,(unsigned long)pc);
+            src += buf;
+            switch( c.op )
+            {
+            case OpFalse: snprintf(buf,sizeof(buf),"(%s){0}",type); break;
+            case OpTrue: snprintf(buf,sizeof(buf),"~(%s){0}",type); break;
+            case OpVar:
+                if( c.a<6 )
+                    snprintf(buf,sizeof(buf),"(%s){0} + 0x%llxULL",type,blockPatterns[c.a]);
+                else
+                {
+                    src += string("(")+type+"){";
+                    for( unsigned k=0; k<w; k++ )
+                    {
+                        snprintf(buf,sizeof(buf),"%s0-(((x+%u)>>%lu)&1)",k?",":"",64*k,(unsigned long)c.a);
+                        src += buf;
+                    }
+                    buf[0] = '}';
+                    buf[1] = '\0';
+                }
+                break;
+            case OpTable:
+                src += string("(")+type+"){";
+                for( unsigned k=0; k<w; k++ )
+                {
+                    snprintf(buf,sizeof(buf),"%st%lu[0",k?",":"",(unsigned long)c.a);
+                    src += buf;
+                    for( U32 j=0; j<p.tables[c.a].count; j++ )
+                    {
+                        snprintf(buf,sizeof(buf),"|((((x+%u)>>%lu)&1)<<%lu)",64*k,
+                                 (unsigned long)p.tables[c.a].vars[j],(unsigned long)j);
+                        src += buf;
+                    }
+                    src += "]";
+                }
+                buf[0] = '}';
+                buf[1] = '\0';
+                break;
+            case OpNot: snprintf(buf,sizeof(buf),"~n%lu",(unsigned long)c.a); break;
+            case OpAnd: snprintf(buf,sizeof(buf),"n%lu & n%lu",(unsigned long)c.a,(unsigned long)c.b); break;
+            case OpOr: snprintf(buf,sizeof(buf),"n%lu | n%lu",(unsigned long)c.a,(unsigned long)c.b); break;
+            case OpXor: snprintf(buf,sizeof(buf),"n%lu ^ n%lu",(unsigned long)c.a,(unsigned long)c.b); break;
+            case OpImplies: snprintf(buf,sizeof(buf),"~n%lu | n%lu",(unsigned long)c.a,(unsigned long)c.b); break;
+            case OpIff: snprintf(buf,sizeof(buf),"~(n%lu ^ n%lu)",(unsigned long)c.a,(unsigned long)c.b); break;
+            }
+            src += buf;
+            src += ";\n";
+        }
+        if( i+1<p.roots.size() )
+        {
+            snprintf(buf,sizeof(buf),"    acc &= n%lu;\n    if( zero_%s(acc) ) return 0;\n",
+                     (unsigned long)p.roots[i],type);
+            src += buf;
+        }
+    }
+    snprintf(buf,sizeof(buf),"    *(%s*)axioms = acc;\n    *(%s*)theorem = n%lu;\n    return 1;\n}\n\n",
+             type,type,(unsigned long)p.roots.back());
+    src += buf;
+    return src;
+}
+
+//The CPU that -march=native builds for: the machine, and on x86 the vendor, signature and
+//feature words of CPUID (without the APIC ID, which differs between cores)
+string nativeTarget()
+{
+    string t;
+    struct utsname u;
+    if( uname(&u)==0 )
+        t = u.machine;
+#if defined(__x86_64__) || defined(__i386__)
+    const unsigned leaves[] = { 0, 1, 7, 0x80000001 };
+    for( unsigned i=0; i<4; i++ )
+    {
+        unsigned r[4] = { 0, 0, 0, 0 };
+        if( !__get_cpuid_count(leaves[i],0,&r[0],&r[1],&r[2],&r[3]) )
+            continue;
+        if( leaves[i]==1 )
+            r[1] = 0;
+        char buf[64];
+        snprintf(buf,sizeof(buf)," %x:%x.%x.%x.%x",leaves[i],r[0],r[1],r[2],r[3]);
+        t += buf;
+    }
+#endif
+    return t;
+}
+
+//Directory of compiled propositions: $PROPCHECK_CACHE, or else propcheck in
+//$XDG_CACHE_HOME or ~/.cache. Missing directories on the way are created accessible to the
+//user alone. Returns false with the reason in error if there is none.
+bool nativeCacheDir(string& dir, string& error)
+{
+    const char* cache = getenv("PROPCHECK_CACHE");
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if( cache && *cache )
+        dir = cache;
+    else if( xdg && *xdg )
+        dir = string(xdg)+"/propcheck";
+    else if( home && *home )
+        dir = string(home)+"/.cache/propcheck";
+    else
+    {
+        error = "No directory for --compile builds, set $PROPCHECK_CACHE";
+        return false;
+    }
+    for( size_t end=dir.find('/',1); ; end=dir.find('/',end+1) )
+    {
+        string part = dir.substr(0,end);
+        if( mkdir(part.c_str(),0700)!=0 && errno!=EEXIST )
+        {
+            error = "Cannot create the cache directory "+part+": "+strerror(errno);
+            return false;
+        }
+        if( end==string::npos )
+            break;
+    }
+    return true;
+}
+
+//Whether no other user can have put something at path: owned by this user, writable by no
+//one else, and a directory, or a regular file that is not a link
+bool isPrivate(const string& path, bool directory)
+{
+    struct stat st;
+    if( directory ? stat(path.c_str(),&st)!=0 : lstat(path.c_str(),&st)!=0 )
+        return false;
+    return (directory ? S_ISDIR(st.st_mode) : S_ISREG(st.st_mode)) &&
+           st.st_uid==getuid() && !(st.st_mode & (S_IWGRP|S_IWOTH));
+}
+
+//Runs a program with arguments, without a shell; true if it exits with status 0
+bool runCommand(const vector<string>& args)
+{
+    vector<char*> argv;
+    for( size_t i=0; i<args.size(); i++ )
+        argv.push_back(const_cast<char*>(args[i].c_str()));
+    argv.push_back(0);
+    pid_t pid = fork();
+    if( pid<0 )
+        return false;
+    if( pid==0 )
+    {
+        execvp(argv[0],argv.data());
+        _exit(127);
+    }
+    int status;
+    while( waitpid(pid,&status,0)<0 )
+        if( errno!=EINTR )
+            return false;
+    return WIFEXITED(status) && WEXITSTATUS(status)==0;
+}
+
+struct NativeEvaluator : public Evaluator
+{
+    void* lib;
+    NativeRun fn;
+    string error;
+
+    NativeEvaluator(const Program& p, unsigned w) : lib(0), fn(0)
+    {
+        words = w;
+        string src =
+            "typedef unsigned long long u64;\n"
+            "typedef u64 v8 __attribute__((vector_size(64),aligned(8)));\n"
+            "static int zero_u64(u64 a) { return !a; }\n"
+            "static int zero_v8(v8 a) { u64 r=0; for(int k=0; k<8; k++) r|=a[k]; return !r; }\n\n";
+        for( size_t i=0; i<p.tables.size(); i++ )
+        {
+            char buf[64];
+            snprintf(buf,sizeof(buf),"static const u64 t%lu[] = {",(unsigned long)i);
+            src += buf;
+            for( size_t k=0; k<p.tables[i].words.size(); k++ )
+            {
+                snprintf(buf,sizeof(buf),"%s0x%llxULL",k?",":"",p.tables[i].words[k]);
+                src += buf;
+            }
+            src += "};\n";
+        }
+        src += emitNative(p,"propcheck_run1","u64",1);
+        src += emitNative(p,"propcheck_run8","v8",8);
+
+        const char* cc = getenv("CC");
+        if( !cc || !*cc )
+            cc = "cc";
+        string dir;
+        if( !nativeCacheDir(dir,error) )
+            return;
+        if( !isPrivate(dir,true) )
+        {
+            error = "The cache directory "+dir+
+                    " must be owned by this user and writable by no one else";
+            return;
+        }
+        char name[64];
+        snprintf(name,sizeof(name),"/propcheck-%016llx",
+                 fnv1a(src,fnv1a(nativeTarget(),fnv1a(cc))));
+        string base = dir+name;
+        string so = base+".so";
+
+        struct stat st;
+        if( lstat(so.c_str(),&st)==0 )
+        {
+            if( !isPrivate(so,false) )
+            {
+                error = "Not loading "+so+", which is not private to this user";
+                return;
+            }
+            lib = dlopen(so.c_str(),RTLD_NOW|RTLD_LOCAL);
+        }
+        if( !lib ) //Not cached yet
+        {
+            //Build in a fresh directory of its own, so concurrent runs do not collide
+            string work = base+".XXXXXX";
+            if( !mkdtemp(&work[0]) )
+            {
+                error = "Cannot create a build directory in "+dir+": "+strerror(errno);
+                return;
+            }
+            string c = work+"/run.c";
+            string tmp = work+"/run.so";
+            int fd = open(c.c_str(),O_WRONLY|O_CREAT|O_EXCL|O_NOFOLLOW,0600);
+            bool written = fd>=0 && write(fd,src.data(),src.size())==ssize_t(src.size());
+            if( fd>=0 )
+                close(fd);
+            if( !written )
+            {
+                error = "Cannot write "+c;
+                remove(c.c_str());
+                rmdir(work.c_str());
+                return;
+            }
+            //$CC may carry arguments of its own, as in "ccache gcc"
+            vector<string> args;
+            for( const char* a=cc; *a; )
+            {
+                size_t n = strcspn(a," \t");
+                if( n )
+                    args.push_back(string(a,n));
+                a += n;
+                a += strspn(a," \t");
+            }
+            const char* flags[] = { "-O3", "-march=native", "-shared", "-fPIC", "-o" };
+            args.insert(args.end(),flags,flags+5);
+            args.push_back(tmp);
+            args.push_back(c);
+            string cmd;
+            for( size_t i=0; i<args.size(); i++ )
+                cmd += (i ? " " : "")+args[i];
+            bool built = runCommand(args) && chmod(tmp.c_str(),0700)==0 &&
+                         rename(tmp.c_str(),so.c_str())==0;
+            if( built )
+                rename(c.c_str(),(base+".c").c_str());
+            remove(c.c_str());
+            remove(tmp.c_str());
+            rmdir(work.c_str());
+            if( !built )
+            {
+                error = "Compiler failed: "+cmd;
+                return;
+            }
+            if( !isPrivate(so,false) )
+            {
+                error = "Not loading "+so+", which is not private to this user";
+                return;
+            }
+            lib = dlopen(so.c_str(),RTLD_NOW|RTLD_LOCAL);
+            if( !lib )
+            {
+                error = dlerror();
+                return;
+            }
+        }
+        fn = (NativeRun)dlsym(lib,w==1 ? "propcheck_run1" : "propcheck_run8");
+        if( !fn )
+            error = "Missing entry point in "+so;
+    }
+    ~NativeEvaluator()
+    {
+        if( lib )
+            dlclose(lib);
+    }
+    bool run(U64 x, U64 valid, U64* axioms, U64* theorem)
+    {
+        return fn(x,valid,axioms,theorem);
+    }
+};
+#endif
+
+//Gray-code enumeration: consecutive blocks differ in one variable above the first 6, so
+//only the nodes in that variable's fan-out cone are recomputed from cached node values.
+//Blocks are visited in Gray order within aligned chunks and chunks in increasing order;
+//each chunk is finished before reporting, so the smallest counterexample still wins.
+struct GrayEvaluator : public Evaluator
+{
+    Program program;
+    vector<U64> slots;
+    vector<vector<U32>> cones; //Instructions depending on each variable, in program order
+    U32 chunkBits;
+
+    GrayEvaluator(const Program& p, U32 nvars) : program(p), slots(p.code.size()), cones(nvars)
+    {
+        words = 1;
+        chunkBits = nvars>6 ? min(nvars-6,U32(12)) : 0;
+        vector<vector<bool>> depends(nvars,vector<bool>(p.code.size(),false));
+        for( size_t pc=0; pc<p.code.size(); pc++ )
+        {
+            const Insn& c = p.code[pc];
+            for( U32 v=0; v<nvars; v++ )
+            {
+                bool d = c.op==OpVar ? c.a==v :
+                         c.op==OpTable ? p.tables[c.a].uses(v) :
+                         c.op==OpNot ? depends[v][c.a] :
+                         c.op>OpNot ? depends[v][c.a] || depends[v][c.b] : false;
+                if( d )
+                {
+                    depends[v][pc] = true;
+                    cones[v].push_back(U32(pc));
+                }
+            }
+        }
+    }
+    bool run(U64 x, U64 valid, U64* axioms, U64* theorem)
+    {
+        for( size_t pc=0; pc<program.code.size(); pc++ )
+            slots[pc] = evalInsn(program.code[pc],slots.data(),x,program.tables.data());
+        axioms[0] = valid;
+        for( size_t i=0; i+1<program.roots.size(); i++ )
+            axioms[0] &= slots[program.roots[i]];
+        theorem[0] = slots[program.roots.back()];
+        return axioms[0]!=0;
+    }
+    bool scan(U64 begin, U64 end, U64 valid, bool& consistent, U64& cex)
+    {
+        U64 chunk = U64(1)<<chunkBits;
+        for( U64 base=begin; base<end; base+=chunk )
+        {
+            U64 axioms, value;
+            U64 steps = min(chunk,end-base);
+            bool found = false;
+            U64 b = base;
+            run(b*64,valid,&axioms,&value);
+            for( U64 t=1; ; t++ )
+            {
+                if( axioms )
+                {
+                    consistent = true;
+                    U64 bad = axioms & ~value;
+                    if( bad && (!found || b*64+__builtin_ctzll(bad)<cex) )
+                    {
+                        cex = b*64 + __builtin_ctzll(bad);
+                        found = true;
+                    }
+                }
+                if( t>=steps )
+                    break;
+                U32 v = 6 + __builtin_ctzll(t); //Gray code t^(t>>1) flips this variable
+                b ^= U64(1)<<(v-6);
+                const vector<U32>& cone = cones[v];
+                for( size_t i=0; i<cone.size(); i++ )
+                    slots[cone[i]] = evalInsn(program.code[cone[i]],slots.data(),b*64,
+                                              program.tables.data());
+                axioms = valid;
+                for( size_t i=0; i+1<program.roots.size() && axioms; i++ )
+                    axioms &= slots[program.roots[i]];
+                value = slots[program.roots.back()];
+            }
+            if( found )
+                return true;
+        }
+        return false;
+    }
+};
+
+//Branch and bound over partial assignments: variables are fixed one at a time and every
+//proposition is evaluated in three-valued logic, so whole subcubes are skipped once an
+//axiom is definitely false, or once the theorem is definitely true and some assignment is
+//already known to satisfy the axioms. Variables that decide the most nodes go first.
+//Runs on the program, as optimized, a proposition's instructions at a time.
+struct PruneSearch
+{
+    const Program& program;
+    vector<U32> order;
+    vector<signed char> a;    //Partial assignment, -1 where unassigned
+    vector<signed char> slot; //Value of every node, -1 where unknown
+    bool consistent;
+
+    PruneSearch(const Program& p, U32 nvars) :
+        program(p), a(nvars,-1), slot(p.code.size(),-1), consistent(false)
+    {
+        //Rank variables by the propositions, then the DAG nodes, that depend on them
+        vector<vector<bool>> depends(nvars,vector<bool>(p.code.size(),false));
+        vector<U32> nodes(nvars,0), uses(nvars,0);
+        for( size_t pc=0; pc<p.code.size(); pc++ )
+        {
+            const Insn& c = p.code[pc];
+            for( U32 v=0; v<nvars; v++ )
+                if( c.op==OpVar ? c.a==v : c.op==OpNot ? depends[v][c.a] :
+                    c.op>OpNot && (depends[v][c.a] || depends[v][c.b]) )
+                {
+                    depends[v][pc] = true;
+                    nodes[v]++;
+                }
+        }
+        for( size_t i=0; i<p.roots.size(); i++ )
+            for( U32 v=0; v<nvars; v++ )
+                uses[v] += depends[v][p.roots[i]];
+        vector<pair<pair<U32,U32>,U32>> rank;
+        for( U32 v=0; v<nvars; v++ )
+            rank.push_back(make_pair(make_pair(~uses[v],~nodes[v]),v));
+        sort(rank.begin(),rank.end());
+        for( U32 v=0; v<nvars; v++ )
+            order.push_back(rank[v].second);
+    }
+
+    //Proposition i in Kleene logic, once the propositions before it are evaluated
+    int eval(size_t i)
+    {
+        for( size_t pc=i ? program.ends[i-1] : 0; pc<program.ends[i]; pc++ )
+        {
+            const Insn& c = program.code[pc];
+            int x = c.op>=OpNot ? slot[c.a] : 0, y = c.op>OpNot ? slot[c.b] : 0;
+            switch( c.op )
+            {
+            case OpFalse: slot[pc] = 0; break;
+            case OpTrue: slot[pc] = 1; break;
+            case OpVar: slot[pc] = a[c.a]; break;
+            case OpNot: slot[pc] = x<0 ? x : 1-x; break;
+            case OpAnd: slot[pc] = !x || !y ? 0 : x<0 || y<0 ? -1 : 1; break;
+            case OpOr: slot[pc] = x==1 || y==1 ? 1 : x<0 || y<0 ? -1 : 0; break;
+            case OpImplies: slot[pc] = !x || y==1 ? 1 : x<0 || y<0 ? -1 : 0; break;
+            case OpXor: slot[pc] = x<0 || y<0 ? -1 : x^y; break;
+            case OpIff: slot[pc] = x<0 || y<0 ? -1 : 1-(x^y); break;
+            default: slot[pc] = -1; break; //Tables only appear inside the enumerator
+            }
+        }
+        return slot[program.roots[i]];
+    }
+
+    //Returns true with a counterexample in a, unassigned variables left at -1
+    bool search(size_t depth)
+    {
+        bool axiomsTrue = true;
+        size_t n = program.roots.size();
+        for( size_t i=0; i+1<n; i++ )
+        {
+            int t = eval(i);
+            if( t==0 )
+                return false;
+            if( t<0 )
+                axiomsTrue = false;
+        }
+        int theorem = eval(n-1);
+        if( axiomsTrue )
+        {
+            consistent = true;
+            if( theorem==0 )
+                return true;
+        }
+        if( theorem==1 && consistent )
+            return false;
+        if( depth==order.size() )
+            return false;
+        U32 v = order[depth];
+        for( int value=0; value<2; value++ )
+        {
+            a[v] = value;
+            if( search(depth+1) )
+                return true;
+        }
+        a[v] = -1;
+        return false;
+    }
+};
+
+//Clause form for the SAT engines. Literal 2v is variable v and 2v+1 is its negation;
+//the problem variables come first.
+typedef U32 Lit;
+INLINE Lit makeLit(U32 v, bool negative) { return 2*v + (negative ? 1 : 0); }
+struct Cnf
+{
+    U32 vars;
+    vector<vector<Lit>> clauses;
+
+    Cnf(U32 nvars) : vars(nvars) {}
+    U32 newVar() { return vars++; }
+    void add(Lit a) { clauses.push_back(vector<Lit>(1,a)); }
+    void add(Lit a, Lit b) { Lit c[] = { a, b }; clauses.push_back(vector<Lit>(c,c+2)); }
+    void add(Lit a, Lit b, Lit c) { Lit d[] = { a, b, c }; clauses.push_back(vector<Lit>(d,d+3)); }
+};
+
+//Plaisted-Greenbaum encoding of the propositions: the axioms true and, when asked for, the
+//theorem false. A proposition's top-level conjunctions become separate claims and its
+//top-level disjunctions (through negations and implications) one clause, so only the
+//subformulas beneath get a variable. A gate variable only implies its gate where it
+//occurs positively and is only implied by it where it occurs negatively, which halves
+//the clauses of most gates. Shared DAG nodes share their variable; negation complements
+//a literal instead of adding one.
+struct CnfEncoder
+{
+    typedef pair<U32,bool> Claim; //Node and the value it must have
+    const Program& p;
+    vector<char> need;            //Per node: 1 if used positively, 2 if negatively
+    vector<vector<Claim>> clauses;
+
+    CnfEncoder(const Program& program) : p(program), need(program.code.size(),0) {}
+
+    //Collects the disjuncts of "node has value truth"
+    void disjuncts(U32 node, bool truth, vector<Claim>& out)
+    {
+        const Insn& c = p.code[node];
+        if( c.op==OpNot )
+            disjuncts(c.a,!truth,out);
+        else if( (c.op==OpOr && truth) || (c.op==OpAnd && !truth) )
+        {
+            disjuncts(c.a,truth,out);
+            disjuncts(c.b,truth,out);
+        }
+        else if( c.op==OpImplies && truth )
+        {
+            disjuncts(c.a,false,out);
+            disjuncts(c.b,true,out);
+        }
+        else
+            out.push_back(Claim(node,truth));
+    }
+
+    void claim(U32 node, bool truth)
+    {
+        const Insn& c = p.code[node];
+        if( c.op==OpNot )
+            claim(c.a,!truth);
+        else if( (c.op==OpAnd && truth) || (c.op==OpOr && !truth) )
+        {
+            claim(c.a,truth);
+            claim(c.b,truth);
+        }
+        else if( c.op==OpImplies && !truth )
+        {
+            claim(c.a,true);
+            claim(c.b,false);
+        }
+        else
+        {
+            //Constants satisfy the clause or drop out of it, unless nothing else is left
+            vector<Claim> clause, open;
+            disjuncts(node,truth,clause);
+            for( size_t i=0; i<clause.size(); i++ )
+            {
+                U32 op = p.code[clause[i].first].op;
+                if( op!=OpTrue && op!=OpFalse )
+                    open.push_back(clause[i]);
+                else if( (op==OpTrue)==clause[i].second )
+                    return;
+            }
+            if( !open.empty() )
+                clause.swap(open);
+            for( size_t i=0; i<clause.size(); i++ )
+                need[clause[i].first] |= clause[i].second ? 1 : 2;
+            clauses.push_back(clause);
+        }
+    }
+
+    void encode(Cnf& cnf)
+    {
+        //Push the polarities down, operands come before their users
+        for( size_t pc=p.code.size(); pc-->0; )
+        {
+            const Insn& c = p.code[pc];
+            char swapped = char(((need[pc]&1)<<1) | ((need[pc]&2)>>1));
+            char both = need[pc] ? 3 : 0;
+            switch( c.op )
+            {
+            case OpNot: need[c.a] |= swapped; break;
+            case OpAnd: case OpOr: need[c.a] |= need[pc]; need[c.b] |= need[pc]; break;
+            case OpImplies: need[c.a] |= swapped; need[c.b] |= need[pc]; break;
+            case OpXor: case OpIff: need[c.a] |= both; need[c.b] |= both; break;
+            default: break;
+            }
+        }
+
+        vector<Lit> lit(p.code.size());
+        for( size_t pc=0; pc<p.code.size(); pc++ )
+        {
+            const Insn& c = p.code[pc];
+            if( !need[pc] )
+                continue;
+            if( c.op==OpVar )
+            {
+                lit[pc] = makeLit(c.a,false);
+                continue;
+            }
+            if( c.op==OpNot )
+            {
+                lit[pc] = lit[c.a]^1;
+                continue;
+            }
+            Lit g = makeLit(cnf.newVar(),false);
+            Lit a = c.op>OpNot ? lit[c.a] : 0, b = c.op>OpNot ? lit[c.b] : 0;
+            bool pos = need[pc]&1, neg = need[pc]&2;
+            lit[pc] = g;
+            switch( c.op )
+            {
+            case OpFalse: cnf.add(g^1); break;
+            case OpTrue: cnf.add(g); break;
+            case OpAnd:
+                if( pos ) { cnf.add(g^1,a); cnf.add(g^1,b); }
+                if( neg ) cnf.add(g,a^1,b^1);
+                break;
+            case OpOr:
+                if( pos ) cnf.add(g^1,a,b);
+                if( neg ) { cnf.add(g,a^1); cnf.add(g,b^1); }
+                break;
+            case OpImplies:
+                if( pos ) cnf.add(g^1,a^1,b);
+                if( neg ) { cnf.add(g,a); cnf.add(g,b^1); }
+                break;
+            case OpXor:
+                if( pos ) { cnf.add(g^1,a,b); cnf.add(g^1,a^1,b^1); }
+                if( neg ) { cnf.add(g,a^1,b); cnf.add(g,a,b^1); }
+                break;
+            case OpIff:
+                if( pos ) { cnf.add(g^1,a^1,b); cnf.add(g^1,a,b^1); }
+                if( neg ) { cnf.add(g,a,b); cnf.add(g,a^1,b^1); }
+                break;
+            default: break;
+            }
+        }
+        for( size_t i=0; i<clauses.size(); i++ )
+        {
+            vector<Lit> clause;
+            for( size_t j=0; j<clauses[i].size(); j++ )
+                clause.push_back(lit[clauses[i][j].first] ^ (clauses[i][j].second ? 0 : 1));
+            //A shared operand can show up twice, or in both signs
+            sort(clause.begin(),clause.end());
+            clause.erase(unique(clause.begin(),clause.end()),clause.end());
+            bool tautology = false;
+            for( size_t j=1; j<clause.size(); j++ )
+                tautology |= (clause[j]^1)==clause[j-1];
+            if( !tautology )
+                cnf.clauses.push_back(clause);
+        }
+    }
+};
+
+Cnf encodeProgram(const Program& p, U32 nvars, bool negatedTheorem)
+{
+    CnfEncoder encoder(p);
+    for( size_t i=0; i+1<p.roots.size(); i++ )
+        encoder.claim(p.roots[i],true);
+    if( negatedTheorem )
+        encoder.claim(p.roots.back(),false);
+    Cnf cnf(nvars);
+    encoder.encode(cnf);
+    return cnf;
+}
+
+//Set once an engine of the portfolio has answered; the others poll it in their inner loops
+//and give up
+atomic<bool> cancelled(false);
+
+//DPLL: chronological backtracking over decisions, with unit propagation through the
+//clauses of each falsified literal and pure-literal elimination before every decision.
+//Branches on the problem variable occurring most often, and most evenly in both signs, in
+//the short clauses not yet satisfied (each clause weighs 2^-unassigned literals); the
+//Tseitin variables mostly follow by propagation once their operands are known.
+struct Dpll
+{
+    const Cnf& cnf;
+    U32 inputs;                 //Variables to branch on
+    vector<vector<U32>> occurs; //Clauses containing each literal
+    vector<signed char> value;  //Per variable: 0 or 1, -1 if unassigned
+    vector<Lit> trail;          //Assigned literals in order
+    size_t head;                //Trail entries propagated so far
+    vector<size_t> levels;      //Trail position of each decision
+    vector<bool> flipped;       //Whether each decision already tried both values
+
+    Dpll(const Cnf& c, U32 nvars) : cnf(c), inputs(nvars), occurs(2*c.vars), value(c.vars,-1), head(0)
+    {
+        for( size_t i=0; i<cnf.clauses.size(); i++ )
+            for( size_t j=0; j<cnf.clauses[i].size(); j++ )
+                occurs[cnf.clauses[i][j]].push_back(U32(i));
+    }
+
+    int litValue(Lit l) const { return value[l>>1]<0 ? -1 : value[l>>1]^int(l&1); }
+    void assign(Lit l) { value[l>>1] = (signed char)(1^(l&1)); trail.push_back(l); }
+    void undo(size_t size)
+    {
+        while( trail.size()>size )
+        {
+            value[trail.back()>>1] = -1;
+            trail.pop_back();
+        }
+        head = min(head,size);
+    }
+
+    //Returns false on a conflict
+    bool propagate()
+    {
+        for( ; head<trail.size(); head++ )
+        {
+            const vector<U32>& watch = occurs[trail[head]^1];
+            for( size_t i=0; i<watch.size(); i++ )
+            {
+                const vector<Lit>& clause = cnf.clauses[watch[i]];
+                Lit unit = 0;
+                U32 open = 0;
+                bool satisfied = false;
+                for( size_t j=0; j<clause.size() && !satisfied; j++ )
+                {
+                    int v = litValue(clause[j]);
+                    if( v==1 )
+                        satisfied = true;
+                    else if( v<0 )
+                    {
+                        unit = clause[j];
+                        open++;
+                    }
+                }
+                if( satisfied || open>1 )
+                    continue;
+                if( open==0 )
+                    return false;
+                assign(unit);
+            }
+        }
+        return true;
+    }
+
+    //Assigns pure literals and picks the next decision; returns false once every clause
+    //is satisfied
+    bool decide(Lit& decision)
+    {
+        vector<double> count(occurs.size(),0);
+        bool open = false;
+        for( size_t i=0; i<cnf.clauses.size(); i++ )
+        {
+            const vector<Lit>& clause = cnf.clauses[i];
+            bool satisfied = false;
+            for( size_t j=0; j<clause.size() && !satisfied; j++ )
+                satisfied = litValue(clause[j])==1;
+            if( satisfied )
+                continue;
+            open = true;
+            U32 free = 0;
+            for( size_t j=0; j<clause.size(); j++ )
+                free += value[clause[j]>>1]<0;
+            double weight = ldexp(1.0,-int(free)); //Long DIMACS clauses overflow a shift
+            for( size_t j=0; j<clause.size(); j++ )
+                if( value[clause[j]>>1]<0 )
+                    count[clause[j]] += weight;
+        }
+        if( !open )
+            return false;
+        double best = 0;
+        decision = Lit(-1);
+        for( U32 v=0; v<value.size(); v++ )
+        {
+            double pos = count[2*v], neg = count[2*v+1];
+            double score = pos*neg*1024 + pos + neg + (v<inputs ? 1e9 : 0);
+            if( value[v]>=0 || pos+neg==0 )
+                continue;
+            if( !pos || !neg )
+                assign(makeLit(v,!pos));
+            else if( score>best )
+            {
+                best = score;
+                decision = makeLit(v,neg>pos);
+            }
+        }
+        return true;
+    }
+
+    //Returns true with a model in value, unassigned variables left at -1
+    bool solve()
+    {
+        while( true )
+        {
+            if( !propagate() )
+            {
+                while( !levels.empty() && flipped.back() )
+                {
+                    undo(levels.back());
+                    levels.pop_back();
+                    flipped.pop_back();
+                }
+                if( levels.empty() || cancelled )
+                    return false;
+                Lit d = trail[levels.back()];
+                undo(levels.back());
+                flipped.back() = true;
+                assign(d^1);
+                continue;
+            }
+            Lit d;
+            if( !decide(d) )
+                return true;
+            if( d==Lit(-1) ) //Only pure literals were left to assign
+                continue;
+            levels.push_back(trail.size());
+            flipped.push_back(false);
+            assign(d);
+        }
+    }
+};
+
+//CDCL: two watched literals per clause, first-UIP learning with recursive minimization,
+//EVSIDS branching with phase saving, Luby restarts, and a learnt clause database halved
+//by literal block distance (LBD, the decision levels in a clause) every few thousand
+//conflicts, always keeping the glue clauses of LBD 2 or less.
+struct Cdcl
+{
+    struct Clause
+    {
+        vector<Lit> lits; //A clause propagating lits[0] has it first
+        bool learnt;
+        bool deleted;
+        U32 lbd;
+    };
+    struct Watch
+    {
+        U32 clause;
+        Lit blocker; //Another literal of the clause; while it is true the clause is skipped
+    };
+    static const U32 NoClause = U32(-1);
+
+    vector<Clause> clauses;
+    vector<U32> learnts;
+    vector<vector<Watch>> watches; //Clauses to visit when each literal becomes false
+    vector<signed char> value;     //Per variable: 0 or 1, -1 if unassigned
+    vector<U32> level;
+    vector<U32> reason;            //Clause that implied each variable
+    vector<Lit> trail;
+    vector<size_t> levels;         //Trail position of each decision
+    size_t head;
+    vector<double> activity;
+    double bump;
+    vector<bool> phase;            //Last sign of each variable, true if negative
+    vector<U32> heap;              //Unassigned variables by activity, a binary max-heap
+    vector<int> place;             //Position of each variable in the heap, -1 if absent
+    vector<char> seen;
+    bool ok;
+
+    Cdcl(const Cnf& cnf) : watches(2*cnf.vars), value(cnf.vars,-1), level(cnf.vars,0),
+        reason(cnf.vars,NoClause), head(0), activity(cnf.vars,0), bump(1),
+        phase(cnf.vars,true), place(cnf.vars,-1), seen(cnf.vars,0), ok(true)
+    {
+        for( U32 v=0; v<cnf.vars; v++ )
+            heapInsert(v);
+        for( size_t i=0; i<cnf.clauses.size() && ok; i++ )
+        {
+            vector<Lit> c = cnf.clauses[i];
+            sort(c.begin(),c.end());
+            c.erase(unique(c.begin(),c.end()),c.end());
+            bool tautology = false;
+            for( size_t j=0; j+1<c.size(); j++ )
+                tautology |= (c[j]^1)==c[j+1];
+            if( tautology )
+                continue;
+            if( c.empty() )
+                ok = false;
+            else if( c.size()==1 )
+            {
+                if( litValue(c[0])==0 )
+                    ok = false;
+                else if( litValue(c[0])<0 )
+                    assign(c[0],NoClause);
+            }
+            else
+                attach(c,false,0);
+        }
+        if( ok && propagate()!=NoClause )
+            ok = false;
+    }
+
+    int litValue(Lit l) const { return value[l>>1]<0 ? -1 : value[l>>1]^int(l&1); }
+    U32 decisionLevel() const { return U32(levels.size()); }
+
+    void assign(Lit l, U32 why)
+    {
+        value[l>>1] = (signed char)(1^(l&1));
+        level[l>>1] = decisionLevel();
+        reason[l>>1] = why;
+        trail.push_back(l);
+    }
+
+    U32 attach(const vector<Lit>& lits, bool learnt, U32 lbd)
+    {
+        Clause c;
+        c.lits = lits;
+        c.learnt = learnt;
+        c.deleted = false;
+        c.lbd = lbd;
+        U32 ci = U32(clauses.size());
+        clauses.push_back(c);
+        Watch w0 = { ci, lits[1] }, w1 = { ci, lits[0] };
+        watches[lits[0]].push_back(w0);
+        watches[lits[1]].push_back(w1);
+        if( learnt )
+            learnts.push_back(ci);
+        return ci;
+    }
+
+    //Binary heap over the variables, ordered by activity
+    bool above(U32 a, U32 b) const { return activity[a]>activity[b]; }
+    void heapMove(size_t i, U32 v) { heap[i] = v; place[v] = int(i); }
+    void heapUp(size_t i)
+    {
+        U32 v = heap[i];
+        for( ; i>0 && above(v,heap[(i-1)/2]); i=(i-1)/2 )
+            heapMove(i,heap[(i-1)/2]);
+        heapMove(i,v);
+    }
+    void heapDown(size_t i)
+    {
+        U32 v = heap[i];
+        while( 2*i+1<heap.size() )
+        {
+            size_t child = 2*i+1;
+            if( child+1<heap.size() && above(heap[child+1],heap[child]) )
+                child++;
+            if( !above(heap[child],v) )
+                break;
+            heapMove(i,heap[child]);
+            i = child;
+        }
+        heapMove(i,v);
+    }
+    void heapInsert(U32 v)
+    {
+        if( place[v]>=0 )
+            return;
+        heap.push_back(v);
+        place[v] = int(heap.size()-1);
+        heapUp(heap.size()-1);
+    }
+    U32 heapPop()
+    {
+        U32 v = heap[0];
+        place[v] = -1;
+        U32 last = heap.back();
+        heap.pop_back();
+        if( !heap.empty() )
+        {
+            heapMove(0,last);
+            heapDown(0);
+        }
+        return v;
+    }
+
+    void bumpVar(U32 v)
+    {
+        activity[v] += bump;
+        if( activity[v]>1e100 )
+        {
+            for( size_t i=0; i<activity.size(); i++ )
+                activity[i] *= 1e-100;
+            bump *= 1e-100;
+        }
+        if( place[v]>=0 )
+            heapUp(place[v]);
+    }
+
+    //Returns the conflicting clause, or NoClause
+    U32 propagate()
+    {
+        while( head<trail.size() )
+        {
+            Lit f = trail[head++]^1; //Just became false
+            vector<Watch>& ws = watches[f];
+            size_t i = 0, j = 0;
+            while( i<ws.size() )
+            {
+                Watch w = ws[i++];
+                if( litValue(w.blocker)==1 )
+                {
+                    ws[j++] = w;
+                    continue;
+                }
+                vector<Lit>& c = clauses[w.clause].lits;
+                if( c[0]==f )
+                    swap(c[0],c[1]);
+                Watch keep = { w.clause, c[0] };
+                if( c[0]!=w.blocker && litValue(c[0])==1 )
+                {
+                    ws[j++] = keep;
+                    continue;
+                }
+                bool moved = false;
+                for( size_t k=2; k<c.size() && !moved; k++ )
+                    if( litValue(c[k])!=0 )
+                    {
+                        swap(c[1],c[k]);
+                        watches[c[1]].push_back(keep);
+                        moved = true;
+                    }
+                if( moved )
+                    continue;
+                ws[j++] = keep;
+                if( litValue(c[0])==0 )
+                {
+                    while( i<ws.size() )
+                        ws[j++] = ws[i++];
+                    ws.resize(j);
+                    head = trail.size();
+                    return w.clause;
+                }
+                assign(c[0],w.clause);
+            }
+            ws.resize(j);
+        }
+        return NoClause;
+    }
+
+    void backtrack(U32 target)
+    {
+        if( decisionLevel()<=target )
+            return;
+        for( size_t i=trail.size(); i-->levels[target]; )
+        {
+            U32 v = trail[i]>>1;
+            phase[v] = trail[i]&1;
+            value[v] = -1;
+            reason[v] = NoClause;
+            heapInsert(v);
+        }
+        trail.resize(levels[target]);
+        levels.resize(target);
+        head = trail.size();
+    }
+
+    U32 abstractLevel(U32 v) const { return U32(1)<<(level[v] & 31); }
+
+    //Whether p follows from the other literals of the learnt clause, which are marked seen
+    bool redundant(Lit p, U32 abstract, vector<Lit>& cleared)
+    {
+        vector<Lit> stack(1,p);
+        size_t top = cleared.size();
+        while( !stack.empty() )
+        {
+            const vector<Lit>& c = clauses[reason[stack.back()>>1]].lits;
+            stack.pop_back();
+            for( size_t i=1; i<c.size(); i++ )
+            {
+                U32 v = c[i]>>1;
+                if( seen[v] || level[v]==0 )
+                    continue;
+                if( reason[v]==NoClause || !(abstractLevel(v) & abstract) )
+                {
+                    for( size_t k=top; k<cleared.size(); k++ )
+                        seen[cleared[k]>>1] = 0;
+                    cleared.resize(top);
+                    return false;
+                }
+                seen[v] = 1;
+                stack.push_back(c[i]);
+                cleared.push_back(c[i]);
+            }
+        }
+        return true;
+    }
+
+    //First-UIP conflict analysis; the asserting literal comes first in learnt, a literal of
+    //the backjump level second
+    void analyze(U32 conflict, vector<Lit>& learnt, U32& target)
+    {
+        learnt.assign(1,0);
+        int paths = 0;
+        Lit p = 0;
+        bool first = true;
+        size_t index = trail.size();
+        do
+        {
+            const vector<Lit>& c = clauses[conflict].lits;
+            for( size_t j=first ? 0 : 1; j<c.size(); j++ )
+            {
+                U32 v = c[j]>>1;
+                if( seen[v] || level[v]==0 )
+                    continue;
+                seen[v] = 1;
+                bumpVar(v);
+                if( level[v]>=decisionLevel() )
+                    paths++;
+                else
+                    learnt.push_back(c[j]);
+            }
+            first = false;
+            while( !seen[trail[--index]>>1] )
+                ;
+            p = trail[index];
+            conflict = reason[p>>1];
+            seen[p>>1] = 0;
+            paths--;
+        } while( paths>0 );
+        learnt[0] = p^1;
+
+        vector<Lit> cleared(learnt.begin()+1,learnt.end());
+        U32 abstract = 0;
+        for( size_t i=1; i<learnt.size(); i++ )
+            abstract |= abstractLevel(learnt[i]>>1);
+        size_t kept = 1;
+        for( size_t i=1; i<learnt.size(); i++ )
+            if( reason[learnt[i]>>1]==NoClause || !redundant(learnt[i],abstract,cleared) )
+                learnt[kept++] = learnt[i];
+        learnt.resize(kept);
+        for( size_t i=0; i<cleared.size(); i++ )
+            seen[cleared[i]>>1] = 0;
+
+        target = 0;
+        if( learnt.size()>1 )
+        {
+            size_t deepest = 1;
+            for( size_t i=2; i<learnt.size(); i++ )
+                if( level[learnt[i]>>1]>level[learnt[deepest]>>1] )
+                    deepest = i;
+            swap(learnt[1],learnt[deepest]);
+            target = level[learnt[1]>>1];
+        }
+    }
+
+    U32 lbd(const vector<Lit>& lits)
+    {
+        vector<U32> seenLevels;
+        for( size_t i=0; i<lits.size(); i++ )
+            seenLevels.push_back(level[lits[i]>>1]);
+        sort(seenLevels.begin(),seenLevels.end());
+        return U32(unique(seenLevels.begin(),seenLevels.end())-seenLevels.begin());
+    }
+
+    //Deletes the worse half of the learnt clauses by LBD, except glue and reason clauses
+    void reduce()
+    {
+        vector<pair<U32,U32>> order;
+        for( size_t i=0; i<learnts.size(); i++ )
+            order.push_back(make_pair(~clauses[learnts[i]].lbd,learnts[i]));
+        sort(order.begin(),order.end());
+        vector<U32> kept;
+        for( size_t i=0; i<order.size(); i++ )
+        {
+            Clause& c = clauses[order[i].second];
+            bool locked = reason[c.lits[0]>>1]==order[i].second && litValue(c.lits[0])==1;
+            if( i<order.size()/2 && c.lbd>2 && !locked )
+            {
+                c.deleted = true;
+                vector<Lit>().swap(c.lits);
+            }
+            else
+                kept.push_back(order[i].second);
+        }
+        learnts.swap(kept);
+        for( size_t l=0; l<watches.size(); l++ )
+        {
+            vector<Watch>& ws = watches[l];
+            size_t j = 0;
+            for( size_t i=0; i<ws.size(); i++ )
+                if( !clauses[ws[i].clause].deleted )
+                    ws[j++] = ws[i];
+            ws.resize(j);
+        }
+    }
+
+    static U64 luby(U64 i) //1 1 2 1 1 2 4 1 1 2 ...
+    {
+        U64 size = 1, seq = 0;
+        while( size<i+1 )
+        {
+            seq++;
+            size = 2*size+1;
+        }
+        while( size-1!=i )
+        {
+            size = (size-1)/2;
+            seq--;
+            i %= size;
+        }
+        return U64(1)<<seq;
+    }
+
+    //Returns true with a model in value
+    bool solve()
+    {
+        if( !ok )
+            return false;
+        U64 conflicts = 0, restarts = 0, sinceRestart = 0, nextReduce = 2000, reductions = 0;
+        vector<Lit> learnt;
+        while( true )
+        {
+            U32 conflict = propagate();
+            if( conflict!=NoClause )
+            {
+                conflicts++;
+                sinceRestart++;
+                if( !decisionLevel() || cancelled )
+                    return false;
+                U32 target;
+                analyze(conflict,learnt,target);
+                backtrack(target);
+                if( learnt.size()==1 )
+                    assign(learnt[0],NoClause);
+                else
+                    assign(learnt[0],attach(learnt,true,lbd(learnt)));
+                bump /= 0.95;
+                if( conflicts>=nextReduce )
+                {
+                    reduce();
+                    nextReduce += 2000 + 300*++reductions;
+                }
+                continue;
+            }
+            if( sinceRestart>=100*luby(restarts) )
+            {
+                backtrack(0);
+                restarts++;
+                sinceRestart = 0;
+            }
+            U32 v = U32(-1);
+            while( !heap.empty() && v==U32(-1) )
+            {
+                v = heapPop();
+                if( value[v]>=0 )
+                    v = U32(-1);
+            }
+            if( v==U32(-1) )
+                return true;
+            levels.push_back(trail.size());
+            assign(makeLit(v,phase[v]),NoClause);
+        }
+    }
+};
+const U32 Cdcl::NoClause;
+
+//Reduced ordered BDDs with complement edges. An edge is a node index times 2 plus a
+//complement bit; node 0 is the terminal, so edge 0 is true and edge 1 false. The high
+//edge of a node is never complemented, which keeps every function's graph unique. Nodes
+//are found through a hash table per level, and AND and XOR results through a lossy
+//direct-mapped cache. A node counts the references from its parents and from outside;
+//nodes that reach 0 stay usable until collect() frees them, top down, so a parent is
+//always freed before its children are looked at.
+//Variables sit at levels given by order, and sifting moves each one through all levels
+//by swapping neighbours in place, settling it where the graph was smallest. A swap keeps
+//the function of every node, so edges held outside stay valid.
+//With several workers an operation forks its two cofactor subproblems near the top of the
+//recursion onto work-stealing deques. Nodes sit in chunks that never move, hash chains
+//gain nodes by compare-and-swap on their head, and cache entries carry a sequence number
+//that is odd while a worker writes them, so readers and writers never block each other.
+//A worker that overfills a subtable doubles it once the others have stepped out of the
+//hash chains; they wait for it at their next node lookup. Collection and sifting only
+//happen between operations.
+struct Bdd
+{
+    typedef U32 Edge;
+    static const Edge True = 0, False = 1;
+    static const U32 Terminal = U32(-1); //Level of the terminal, below all others
+    static const U32 ChunkBits = 16;     //Nodes per chunk, as a power of 2
+    static const U32 Block = 256;        //Fresh nodes a worker claims at a time
+    static const U32 SpawnDepth = 12;    //Recursion depth below which subproblems run inline
+    enum { CacheAnd, CacheXor };
+
+    struct Node
+    {
+        U32 var;
+        Edge lo, hi;
+        U32 next; //Next node in the same hash chain, 0 for none
+        U32 ref;
+    };
+    struct Subtable
+    {
+        vector<U32> buckets;
+        U32 count;
+    };
+    struct Entry
+    {
+        U32 stamp; //Odd while being written
+        U32 op;
+        Edge f, g, r;
+    };
+    struct Task
+    {
+        U32 op;
+        Edge f, g;
+        U32 depth;
+        Edge result;
+        atomic<bool> done;
+    };
+    struct WorkQueue
+    {
+        mutex m;
+        deque<Task*> tasks;
+    };
+    struct Worker
+    {
+        vector<U32> spare;       //Freed node indices
+        U32 fresh, freshEnd;     //Claimed, never used node indices
+        atomic<bool> busy;       //In a hash chain
+        char pad[64];
+    };
+    struct NodeStore
+    {
+        vector<Node*> chunks;    //Allocated once each, when the first block in them is claimed
+        U32 claimed;             //Node indices handed out
+        NodeStore() : chunks(U32(1)<<(32-ChunkBits),(Node*)0), claimed(0) {}
+        ~NodeStore() { for( size_t c=0; c<chunks.size(); c++ ) delete[] chunks[c]; }
+        Node& operator[](U32 n) { return chunks[n>>ChunkBits][n & ((1<<ChunkBits)-1)]; }
+        const Node& operator[](U32 n) const { return chunks[n>>ChunkBits][n & ((1<<ChunkBits)-1)]; }
+    };
+
+    NodeStore nodes;
+    vector<Subtable> subtables;  //Per level
+    vector<U32> level;           //Per variable, and Terminal for the terminal's variable
+    vector<U32> order;           //Variable at each level
+    vector<Entry> cache;
+    U32 live;                    //Nodes in use, dead or alive
+    U32 limit;                   //Collect when live goes past this
+    bool sifting;                //Reorder dynamically
+    U32 siftLimit;               //Sift when live nodes go past this
+    U32 workers;
+    vector<Worker> local;
+    vector<WorkQueue> queues;
+    vector<thread> threads;
+    atomic<bool> quit;
+    atomic<bool> growing;        //A worker is rehashing, the others keep out of the chains
+    bool parallel;               //An operation is running on all workers
+
+    Bdd(const vector<U32>& initial, U32 nworkers) : subtables(initial.size()),
+        level(initial.size()+1,Terminal), order(initial), cache(1<<16), live(1), limit(1<<16),
+        sifting(true), siftLimit(1<<14), workers(nworkers), local(nworkers), queues(nworkers),
+        quit(false), growing(false), parallel(false)
+    {
+        for( U32 w=0; w<workers; w++ )
+        {
+            local[w].fresh = local[w].freshEnd = 0;
+            local[w].busy = false;
+        }
+        U32 t = allocate(0);
+        Node terminal = { U32(initial.size()), True, True, 0, 1 };
+        nodes[t] = terminal;
+        for( U32 l=0; l<order.size(); l++ )
+        {
+            level[order[l]] = l;
+            subtables[l].buckets.assign(64,0);
+            subtables[l].count = 0;
+        }
+        clearCache();
+        for( U32 w=1; w<workers; w++ )
+            threads.push_back(thread(&Bdd::work,this,w));
+    }
+
+    ~Bdd()
+    {
+        quit = true;
+        for( size_t i=0; i<threads.size(); i++ )
+            threads[i].join();
+    }
+
+    static U32 hash(Edge a, Edge b) { return U32((a*0x9E3779B1ULL + b)*0x85EBCA77ULL >> 7); }
+    U32 top(Edge e) const { return level[nodes[e>>1].var]; }
+    Edge lo(Edge e) const { return nodes[e>>1].lo ^ (e&1); }
+    Edge hi(Edge e) const { return nodes[e>>1].hi ^ (e&1); }
+    void clearCache() { for( size_t i=0; i<cache.size(); i++ ) cache[i].op = U32(-1); }
+
+    void ref(Edge e)
+    {
+        if( e>1 && parallel )
+            __atomic_fetch_add(&nodes[e>>1].ref,1,__ATOMIC_RELAXED);
+        else if( e>1 )
+            nodes[e>>1].ref++;
+    }
+    void deref(Edge e) { if( e>1 ) nodes[e>>1].ref--; }
+
+    //A node index for worker w: a freed one, or the next of its block of fresh ones
+    U32 allocate(U32 w)
+    {
+        Worker& k = local[w];
+        if( !k.spare.empty() )
+        {
+            U32 n = k.spare.back();
+            k.spare.pop_back();
+            return n;
+        }
+        if( k.fresh==k.freshEnd )
+        {
+            k.fresh = __atomic_fetch_add(&nodes.claimed,Block,__ATOMIC_RELAXED);
+            k.freshEnd = k.fresh+Block;
+            Node*& chunk = nodes.chunks[k.fresh>>ChunkBits];
+            if( !(k.fresh & ((1<<ChunkBits)-1)) )
+                __atomic_store_n(&chunk,new Node[1<<ChunkBits],__ATOMIC_RELEASE);
+            else
+                while( !__atomic_load_n(&chunk,__ATOMIC_ACQUIRE) )
+                    this_thread::yield();
+        }
+        return k.fresh++;
+    }
+
+    void insert(U32 l, U32 n)
+    {
+        Subtable& t = subtables[l];
+        U32& bucket = t.buckets[hash(nodes[n].lo,nodes[n].hi) & (t.buckets.size()-1)];
+        nodes[n].next = bucket;
+        bucket = n;
+        if( ++t.count > 2*t.buckets.size() )
+            rehash(l);
+    }
+
+    //The node at level l with the given cofactors, made by worker w
+    Edge make(U32 l, Edge lo, Edge hi, U32 w=0)
+    {
+        if( lo==hi )
+            return lo;
+        if( hi&1 )
+            return make(l,lo^1,hi^1,w)^1;
+        if( !parallel )
+            return find(l,lo,hi,0);
+        while( true )
+        {
+            local[w].busy.store(true);
+            if( !growing.load() )
+                break;
+            local[w].busy.store(false);
+            while( growing.load(memory_order_acquire) )
+                this_thread::yield();
+        }
+        Edge r = find(l,lo,hi,w);
+        Subtable& t = subtables[l];
+        bool full = __atomic_load_n(&t.count,__ATOMIC_RELAXED) > 2*t.buckets.size();
+        local[w].busy.store(false,memory_order_release);
+        if( full )
+            grow(l);
+        return r;
+    }
+
+    //Doubles the subtable of level l until it is at most half full, once no other worker
+    //is in a hash chain. Unless another worker is already growing one.
+    void grow(U32 l)
+    {
+        bool idle = false;
+        if( !growing.compare_exchange_strong(idle,true) )
+            return;
+        for( U32 k=0; k<workers; k++ )
+            while( local[k].busy.load() )
+                this_thread::yield();
+        Subtable& t = subtables[l];
+        while( t.count > 2*t.buckets.size() )
+            rehash(l);
+        growing.store(false,memory_order_release);
+    }
+
+    //The node at level l with cofactors lo and hi, added if there is none
+    Edge find(U32 l, Edge lo, Edge hi, U32 w)
+    {
+        Subtable& t = subtables[l];
+        U32* bucket = &t.buckets[hash(lo,hi) & (t.buckets.size()-1)];
+        U32 head = __atomic_load_n(bucket,__ATOMIC_ACQUIRE);
+        for( U32 n=head; n; n=nodes[n].next )
+            if( nodes[n].lo==lo && nodes[n].hi==hi )
+                return n<<1;
+        U32 n = allocate(w);
+        Node& node = nodes[n];
+        node.var = order[l];
+        node.lo = lo;
+        node.hi = hi;
+        node.ref = 0;
+        node.next = head;
+        if( !parallel )
+            *bucket = n;
+        else while( !__atomic_compare_exchange_n(bucket,&node.next,n,false,__ATOMIC_RELEASE,
+                                                 __ATOMIC_ACQUIRE) )
+        {
+            //Other workers linked nodes in first, and one may be this one
+            for( U32 m=node.next; m!=head; m=nodes[m].next )
+                if( nodes[m].lo==lo && nodes[m].hi==hi )
+                {
+                    local[w].spare.push_back(n);
+                    return m<<1;
+                }
+            head = node.next;
+        }
+        ref(lo);
+        ref(hi);
+        if( parallel )
+            __atomic_fetch_add(&t.count,1,__ATOMIC_RELAXED); //Live is counted after the operation
+        else
+        {
+            live++;
+            if( ++t.count > 2*t.buckets.size() )
+                rehash(l);
+        }
+        return n<<1;
+    }
+
+    void rehash(U32 l)
+    {
+        Subtable& t = subtables[l];
+        vector<U32> buckets(2*t.buckets.size(),0);
+        for( size_t b=0; b<t.buckets.size(); b++ )
+            for( U32 n=t.buckets[b], next; n; n=next )
+            {
+                next = nodes[n].next;
+                U32& bucket = buckets[hash(nodes[n].lo,nodes[n].hi) & (buckets.size()-1)];
+                nodes[n].next = bucket;
+                bucket = n;
+            }
+        t.buckets.swap(buckets);
+    }
+
+    Edge var(U32 v) { return make(level[v],False,True); }
+
+    bool lookup(U32 op, Edge f, Edge g, Edge& r)
+    {
+        Entry& e = cache[(hash(f,g)+op) & (cache.size()-1)];
+        U32 stamp = __atomic_load_n(&e.stamp,__ATOMIC_ACQUIRE);
+        bool hit = !(stamp&1) && __atomic_load_n(&e.op,__ATOMIC_RELAXED)==op &&
+                   __atomic_load_n(&e.f,__ATOMIC_RELAXED)==f &&
+                   __atomic_load_n(&e.g,__ATOMIC_RELAXED)==g;
+        r = __atomic_load_n(&e.r,__ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        return hit && __atomic_load_n(&e.stamp,__ATOMIC_RELAXED)==stamp;
+    }
+
+    //Skipped while another worker writes the entry
+    void store(U32 op, Edge f, Edge g, Edge r)
+    {
+        Entry& e = cache[(hash(f,g)+op) & (cache.size()-1)];
+        if( !parallel )
+        {
+            Entry entry = { e.stamp, op, f, g, r };
+            e = entry;
+            return;
+        }
+        U32 stamp = __atomic_load_n(&e.stamp,__ATOMIC_RELAXED);
+        if( (stamp&1) || !__atomic_compare_exchange_n(&e.stamp,&stamp,stamp+1,false,
+                                                      __ATOMIC_ACQUIRE,__ATOMIC_RELAXED) )
+            return;
+        __atomic_store_n(&e.op,op,__ATOMIC_RELAXED);
+        __atomic_store_n(&e.f,f,__ATOMIC_RELAXED);
+        __atomic_store_n(&e.g,g,__ATOMIC_RELAXED);
+        __atomic_store_n(&e.r,r,__ATOMIC_RELAXED);
+        __atomic_store_n(&e.stamp,stamp+2,__ATOMIC_RELEASE);
+    }
+
+    //f AND g or f XOR g on worker w
+    Edge applyRec(U32 op, Edge f, Edge g, U32 w, U32 depth)
+    {
+        Edge c = 0;
+        if( op==CacheAnd )
+        {
+            if( f==g || g==True )
+                return f;
+            if( f==True )
+                return g;
+            if( f==(g^1) || f==False || g==False )
+                return False;
+        }
+        else
+        {
+            //Complements come out: (!f)^g = !(f^g)
+            c = (f^g)&1;
+            f &= ~Edge(1);
+            g &= ~Edge(1);
+            if( f==g )
+                return False^c;
+            if( f==True )
+                return g^1^c;
+            if( g==True )
+                return f^1^c;
+        }
+        if( f>g )
+            swap(f,g);
+        Edge r;
+        if( lookup(op,f,g,r) )
+            return r^c;
+        if( cancelled ) //The result no longer matters
+            return False;
+        U32 l = min(top(f),top(g));
+        Edge f0 = top(f)==l ? lo(f) : f, f1 = top(f)==l ? hi(f) : f;
+        Edge g0 = top(g)==l ? lo(g) : g, g1 = top(g)==l ? hi(g) : g;
+        Edge r0, r1;
+        if( parallel && depth<SpawnDepth )
+        {
+            Task task;
+            task.op = op;
+            task.f = f1;
+            task.g = g1;
+            task.depth = depth+1;
+            task.done = false;
+            {
+                lock_guard<mutex> lock(queues[w].m);
+                queues[w].tasks.push_back(&task);
+            }
+            r0 = applyRec(op,f0,g0,w,depth+1);
+            bool stolen = true;
+            {
+                lock_guard<mutex> lock(queues[w].m);
+                if( !queues[w].tasks.empty() && queues[w].tasks.back()==&task )
+                {
+                    queues[w].tasks.pop_back();
+                    stolen = false;
+                }
+            }
+            if( !stolen )
+                r1 = applyRec(op,f1,g1,w,depth+1);
+            else
+            {
+                //Help out while the thief finishes it
+                while( !task.done.load(memory_order_acquire) )
+                    if( !steal(w) )
+                        this_thread::yield();
+                r1 = task.result;
+            }
+        }
+        else
+        {
+            r0 = applyRec(op,f0,g0,w,depth+1);
+            r1 = applyRec(op,f1,g1,w,depth+1);
+        }
+        r = make(l,r0,r1,w);
+        store(op,f,g,r);
+        return r^c;
+    }
+
+    //Runs the oldest task of another worker's deque on worker w
+    bool steal(U32 w)
+    {
+        for( U32 k=1; k<workers; k++ )
+        {
+            WorkQueue& q = queues[(w+k)%workers];
+            Task* task;
+            {
+                lock_guard<mutex> lock(q.m);
+                if( q.tasks.empty() )
+                    continue;
+                task = q.tasks.front();
+                q.tasks.pop_front();
+            }
+            task->result = applyRec(task->op,task->f,task->g,w,task->depth);
+            task->done.store(true,memory_order_release);
+            return true;
+        }
+        return false;
+    }
+
+    void work(U32 w)
+    {
+        for( U32 idle=0; !quit; )
+        {
+            if( steal(w) )
+                idle = 0;
+            else if( ++idle<64 )
+                this_thread::yield();
+            else
+                this_thread::sleep_for(chrono::microseconds(200));
+        }
+    }
+
+    Edge run(U32 op, Edge f, Edge g)
+    {
+        if( workers==1 )
+            return applyRec(op,f,g,0,0);
+        parallel = true;
+        Edge r = applyRec(op,f,g,0,0);
+        parallel = false;
+        live = 1;
+        for( U32 l=0; l<subtables.size(); l++ )
+        {
+            live += subtables[l].count;
+            while( subtables[l].count > 2*subtables[l].buckets.size() )
+                rehash(l);
+        }
+        return r;
+    }
+
+    Edge bddAnd(Edge f, Edge g) { return run(CacheAnd,f,g); }
+    Edge bddXor(Edge f, Edge g) { return run(CacheXor,f,g); }
+
+    Edge apply(U32 op, Edge a, Edge b)
+    {
+        switch( op )
+        {
+        case OpAnd: return bddAnd(a,b);
+        case OpOr: return bddAnd(a^1,b^1)^1;
+        case OpImplies: return bddAnd(a,b^1)^1;
+        case OpXor: return bddXor(a,b);
+        case OpIff: return bddXor(a,b)^1;
+        }
+        return False;
+    }
+
+    //Frees the nodes no one refers to, spreading them over the workers. Only call it
+    //between operations, with every result still needed referenced.
+    void collect()
+    {
+        U32 freed = 0;
+        for( U32 l=0; l<subtables.size(); l++ )
+        {
+            Subtable& t = subtables[l];
+            for( size_t b=0; b<t.buckets.size(); b++ )
+                for( U32* n=&t.buckets[b]; *n; )
+                {
+                    Node& node = nodes[*n];
+                    if( node.ref )
+                    {
+                        n = &node.next;
+                        continue;
+                    }
+                    deref(node.lo);
+                    deref(node.hi);
+                    local[freed++ % workers].spare.push_back(*n);
+                    *n = node.next;
+                    t.count--;
+                    live--;
+                }
+        }
+        clearCache();
+        limit = max(limit,2*live);
+    }
+
+    //Frees node n at once, and its children that it held last
+    void release(U32 n)
+    {
+        Subtable& t = subtables[top(n<<1)];
+        U32* p = &t.buckets[hash(nodes[n].lo,nodes[n].hi) & (t.buckets.size()-1)];
+        while( *p!=n )
+            p = &nodes[*p].next;
+        *p = nodes[n].next;
+        t.count--;
+        live--;
+        local[0].spare.push_back(n);
+        Edge children[] = { nodes[n].lo, nodes[n].hi };
+        for( int i=0; i<2; i++ )
+        {
+            deref(children[i]);
+            if( children[i]>1 && !nodes[children[i]>>1].ref )
+                release(children[i]>>1);
+        }
+    }
+
+    //Exchanges the variables at levels l and l+1. Nodes at level l that do not depend on
+    //the lower variable just move down; the others are rebuilt in place over new nodes of
+    //the upper variable, leaving the lower variable's nodes that lost their last parent to
+    //be freed. Needs every node referenced, as after collect().
+    void swapLevels(U32 l)
+    {
+        U32 x = order[l], y = order[l+1];
+        vector<U32> upper;
+        Subtable& t = subtables[l];
+        for( size_t b=0; b<t.buckets.size(); b++ )
+        {
+            for( U32 n=t.buckets[b]; n; n=nodes[n].next )
+                upper.push_back(n);
+            t.buckets[b] = 0;
+        }
+        t.count = 0;
+        swap(subtables[l],subtables[l+1]);
+        swap(order[l],order[l+1]);
+        level[x] = l+1;
+        level[y] = l;
+
+        vector<U32> dependent;
+        for( size_t i=0; i<upper.size(); i++ )
+        {
+            U32 n = upper[i];
+            if( nodes[nodes[n].lo>>1].var==y || nodes[nodes[n].hi>>1].var==y )
+                dependent.push_back(n);
+            else
+                insert(l+1,n);
+        }
+        for( size_t i=0; i<dependent.size(); i++ )
+        {
+            U32 n = dependent[i];
+            Edge f0 = nodes[n].lo, f1 = nodes[n].hi;
+            bool y0 = nodes[f0>>1].var==y, y1 = nodes[f1>>1].var==y;
+            Edge f00 = y0 ? lo(f0) : f0, f01 = y0 ? hi(f0) : f0;
+            Edge f10 = y1 ? lo(f1) : f1, f11 = y1 ? hi(f1) : f1;
+            Edge newLo = make(l+1,f00,f10);
+            ref(newLo);
+            Edge newHi = make(l+1,f01,f11);
+            ref(newHi);
+            nodes[n].var = y;
+            nodes[n].lo = newLo;
+            nodes[n].hi = newHi;
+            insert(l,n);
+            Edge old[] = { f0, f1 };
+            for( int k=0; k<2; k++ )
+            {
+                deref(old[k]);
+                if( old[k]>1 && !nodes[old[k]>>1].ref )
+                    release(old[k]>>1);
+            }
+        }
+    }
+
+    //Rudell's sifting: each variable, up to the 1000 with the most nodes, goes to the
+    //nearer end, then to the other, and back to the level where the graph was smallest.
+    //A direction is abandoned once the graph grows 20% past the best size.
+    void sift()
+    {
+        collect();
+        U32 levels = U32(order.size());
+        vector<pair<U32,U32>> vars;
+        for( U32 l=0; l<levels; l++ )
+            vars.push_back(make_pair(subtables[l].count,order[l]));
+        sort(vars.rbegin(),vars.rend());
+        for( size_t i=0; i<vars.size() && i<1000 && !cancelled; i++ )
+        {
+            if( !vars[i].first )
+                break;
+            U32 v = vars[i].second, best = live, bestLevel = level[v];
+            bool downFirst = level[v] >= levels/2;
+            for( int pass=0; pass<2; pass++ )
+            {
+                if( downFirst==(pass==0) )
+                    while( level[v]+1<levels && live<=best+best/5 )
+                    {
+                        swapLevels(level[v]);
+                        if( live<best )
+                            best = live, bestLevel = level[v];
+                    }
+                else
+                    while( level[v]>0 && live<=best+best/5 )
+                    {
+                        swapLevels(level[v]-1);
+                        if( live<best )
+                            best = live, bestLevel = level[v];
+                    }
+            }
+            while( level[v]<bestLevel )
+                swapLevels(level[v]);
+            while( level[v]>bestLevel )
+                swapLevels(level[v]-1);
+        }
+        clearCache();
+    }
+
+    //Collects once enough nodes have piled up, sifts if what is left has doubled since the
+    //last time, and grows the cache with the graph
+    void checkpoint()
+    {
+        if( live>limit )
+        {
+            collect();
+            if( sifting && live>siftLimit )
+            {
+                sift();
+                siftLimit = max(siftLimit,2*live);
+                limit = max(limit,2*live);
+            }
+        }
+        if( live>cache.size() && cache.size()<(1<<24) )
+        {
+            cache.resize(2*cache.size());
+            clearCache();
+        }
+    }
+
+    //Any satisfying assignment of f, preferring false; f must not be False
+    vector<bool> model(Edge f)
+    {
+        vector<bool> values(order.size(),false);
+        while( f>1 )
+        {
+            U32 v = nodes[f>>1].var;
+            values[v] = lo(f)==False;
+            f = values[v] ? hi(f) : lo(f);
+        }
+        return values;
+    }
+};
+const U32 Bdd::Terminal;
+
+//Unique table: structurally identical subterms are built once, so a subformula repeated
+//across propositions becomes a single DAG node. Operands of commutative operators are
+//ordered, which also merges ([A] and [B]) with ([B] and [A]).
+struct NodeKey
+{
+    U32 op;
+    U32 var;
+    const Expr* L;
+    const Expr* R;
+    bool operator==(const NodeKey& k) const { return op==k.op && var==k.var && L==k.L && R==k.R; }
+};
+struct NodeKeyHash
+{
+    size_t operator()(const NodeKey& k) const
+    {
+        return hash<const void*>()(k.L)*31 + hash<const void*>()(k.R)*7 + k.var*131 + k.op;
+    }
+};
+unordered_map<NodeKey,shared_ptr<Expr>,NodeKeyHash> uniqueTable; //Global for simplicity
+
+//Returns the existing node for this structure, or registers node as it
+shared_ptr<Expr> hashCons(Expr* node, U32 op, U32 var,
+                          const shared_ptr<Expr>& L=shared_ptr<Expr>(),
+                          const shared_ptr<Expr>& R=shared_ptr<Expr>())
+{
+    NodeKey k = { op, var, L.get(), R.get() };
+    if( (op==OpAnd || op==OpOr || op==OpXor || op==OpIff) && k.R<k.L )
+        swap(k.L,k.R);
+    unordered_map<NodeKey,shared_ptr<Expr>,NodeKeyHash>::iterator it = uniqueTable.find(k);
+    if( it!=uniqueTable.end() )
+    {
+        delete node;
+        return it->second;
+    }
+    shared_ptr<Expr> p(node);
+    uniqueTable[k] = p;
+    return p;
+}
+
+//Expression Parsing
+U32 parseExpr(const char* s, shared_ptr<Expr>& p);
+
+U32 skipWS(const char* s) //skip Whitespace
+{
+    const char* e = s;
+    while( isspace(*e) ) e++;
+    return (U32)(e-s);
+}
+
+U32 parseString(const char* s, const char* str)
+{
+    const char* e=s;
+    while(*str!='\0' && *e!='\0' && *e==*str)
+    {
+        e++;
+        str++;
+    }
+    if( *str=='\0' )
+        return U32(e-s);
+    return U32(0);
+}
+
+U32 parseOneString(const char* s, const char* str1, const char* str2)
+{
+    U32 n = parseString(s,str1);
+    if( n )
+        return n;
+    return parseString(s,str2);
+}
+
+U32 parseTrue(const char* s, shared_ptr<Expr>& p)
+{
+    if( *s=='T' )
+    {
+        p = hashCons(new True,OpTrue,0);
+        return 1;
+    }
+    U32 n = parseString(s,"true");
+    if(n)
+        p = hashCons(new True,OpTrue,0);
+    return n;
+}
+
+U32 parseFalse(const char* s, shared_ptr<Expr>& p)
+{
+    if( *s=='F' )
+    {
+        p = hashCons(new False,OpFalse,0);
+        return 1;
+    }
+    U32 n = parseString(s,"false");
+    if(n)
+        p = hashCons(new False,OpFalse,0);
+    return n;
+}
+
+vector<string> variables; //Global for simplicity
+U32 parseVar(const char* s, shared_ptr<Expr>& p)
+{
+    const char* e=s;
+    if( *e!='[' )
+        return U32(0);
+    e++;
+    e+=skipWS(e);
+    char const* startstr = e;
+    while( *e!=']' )
+    {
+        if( *e=='\0' )
+            return U32(0);
+        e++;
+    }
+    e--;
+    while( isspace(*e) && e > startstr ) e--;
+    e++;
+    string var(startstr,string::size_type(e-startstr));
+    while( *e!=']' ) e++;
+    e++;
+
+    {
+        int i;
+        for(i=0; i<variables.size(); i++)
+            if( variables[i] == var )
+                break;
+        if( i >= variables.size() )
+            variables.push_back(var);
+        p = hashCons(new Var(i),OpVar,i);
+    }
+    return U32(e-s);
+}
+
+U32 parseNot(const char* s, shared_ptr<Expr>& p)
+{
+    const char* e = s;
+    U32 n = parseOneString(s,"!","not");
+    if(n)
+    {
+        e+=n;
+        shared_ptr<Expr> L;
+        n=parseExpr(e,L);
+        if( n )
+        {
+            e+=n;
+            p=hashCons(new Not(L),OpNot,0,L);
+            return U32(e-s);
+        }
+    }
+    return 0;
+}
+
+U32 parseBinaryExpr(const char* s, shared_ptr<Expr>& p)
+{
+    U32 n;
+    const char* e = s;
+    e += skipWS(e);
+    if( *e!='(' )
+        return 0;
+    e++;
+
+    //Parse Left Expression
+    e += skipWS(e);
+    shared_ptr<Expr> L;
+    n = parseExpr(e,L);
+    if(!n)
+        return 0;
+    e += n;
+
+    //Parse Operation String
+    e+=skipWS(e);
+    const char* startop = e;
+    while( *e!='\0' && *e!='!' && *e!='(' && *e!='[' &&
+           *e!='T' && *e!='F' && (*e!='f' || *(e+1)!='a' ) && (*e!='t' || *(e+1)!='r') &&
+           (*e!='n' || *(e+1)!='o') && !isspace(*e) ) e++;
+    string op(startop,e-startop);
+    e+=skipWS(e);
+
+    //Parse Right Expression
+    e += skipWS(e);
+    shared_ptr<Expr> R;
+    n = parseExpr(e,R);
+    if(!n)
+        return 0;
+    e += n;
+
+    //Parse Closing Parenthesis
+    e += skipWS(e);
+    if( *e!=')' )
+        return 0;
+    e++;
+
+    if( op=="and" || op=="&" )
+    {
+        p = hashCons(new And(L,R),OpAnd,0,L,R);
+        return U32(e-s);
+    }
+    if( op=="or" || op=="|" )
+    {
+        p = hashCons(new Or(L,R),OpOr,0,L,R);
+        return U32(e-s);
+    }
+    if( op=="xor" || op=="^" )
+    {
+        p = hashCons(new Xor(L,R),OpXor,0,L,R);
+        return U32(e-s);
+    }
+    if( op=="then" || op=="implies" || op=="=>" )
+    {
+        p = hashCons(new Implies(L,R),OpImplies,0,L,R);
+        return U32(e-s);
+    }
+    if( op=="if" || op=="<=" )
+    {
+        p = hashCons(new Implies(R,L),OpImplies,0,R,L);
+        return U32(e-s);
+    }
+    if( op=="iff" || op=="<=>" )
+    {
+        p = hashCons(new Iff(L,R),OpIff,0,L,R);
+        return U32(e-s);
+    }
+
+    return 0;
+}
+
+U32 parseExpr(const char* s, shared_ptr<Expr>& p)
+{
+    U32 n;
+    const char* e = s;
+    e += skipWS(e);
+    if( n=parseTrue(e,p) )
+    {
+        e += n;
+        return  U32(e-s);
+    }
+    if( n=parseFalse(e,p) )
+    {
+        e += n;
+        return  U32(e-s);
+    }
+    else if( n=parseVar(e,p) )
+    {
+        e += n;
+        return  U32(e-s);
+    }
+    else if( n=parseNot(e,p) )
+    {
+        e += n;
+        return  U32(e-s);
+    }
+    else if( n=parseBinaryExpr(e,p) )
+    {
+        e += n;
+        return  U32(e-s);
+    }
+    return 0;
+}
+
+U32 parseTopLevelExpr(const char* s, shared_ptr<Expr>& p)
 {
     char const* e = s;
     U32 n = parseExpr(e,p);
@@ -334,36 +3758,1112 @@ U32 parseTopLevelExpr(const char* s, shared_ptr<Expr>& p)
     if( n && *e=='\0' )
         return U32(e-s);
 
-    //Attempt to add parenthesis to expression and parse again
-    std::string test=(std::string("(")+s+")");
-    e = test.c_str();
-    n = parseExpr(e,p);
-    e += n;
-    e += skipWS(e);
-    if( n && *e=='\0' )
-        return U32(e-s);
+    //Attempt to add parenthesis to expression and parse again
+    std::string test=(std::string("(")+s+")");
+    e = test.c_str();
+    n = parseExpr(e,p);
+    e += n;
+    e += skipWS(e);
+    if( n && *e=='\0' )
+        return U32(e-s);
+
+    return 0;
+}
+
+//Reads a DIMACS CNF file: every clause becomes an axiom and the theorem is F, so a
+//counterexample is a model of the clauses and inconsistent axioms mean there is none.
+//Comments "c N [name]", as --emit-dimacs writes them, name variable N; the others are
+//called xN.
+bool readDimacs(FILE* f, const char* filename, vector<shared_ptr<Expr>>& propositions)
+{
+    string text;
+    char buffer[65536];
+    for( size_t n; (n=fread(buffer,1,sizeof(buffer),f))>0; )
+        text.append(buffer,n);
+    text.push_back('\0');
+
+    unsigned long nvars = 0, nclauses = 0, linenum = 0;
+    bool header = false;
+    map<unsigned long,string> names;
+    vector<shared_ptr<Expr>> literals; //Variable v at 2v, its negation at 2v+1
+    shared_ptr<Expr> clause;
+    for( const char* s=text.c_str(); *s; )
+    {
+        const char* e = strchr(s,'\n');
+        e = e ? e+1 : s+strlen(s);
+        linenum++;
+        const char* t = s+skipWS(s);
+        if( *t=='c' )
+        {
+            unsigned long v;
+            int n = 0;
+            const char* open = strchr(t,'[');
+            const char* close = open ? (const char*)memchr(open,']',e-open) : 0;
+            if( sscanf(t,"c %lu %n",&v,&n)==1 && t+n==open && close )
+                names[v] = string(open+1,close);
+        }
+        else if( *t=='p' )
+        {
+            if( header || sscanf(t,"p cnf %lu %lu",&nvars,&nclauses)!=2 )
+            {
+                printf("Error: Bad DIMACS header line %lu in %s\n",linenum,filename);
+                return false;
+            }
+            header = true;
+            for( unsigned long v=0; v<nvars; v++ )
+            {
+                map<unsigned long,string>::iterator it = names.find(v+1);
+                variables.push_back(it!=names.end() ? it->second : "x"+to_string(v+1));
+                literals.push_back(hashCons(new Var(v),OpVar,v));
+                literals.push_back(hashCons(new Not(literals.back()),OpNot,0,literals.back()));
+            }
+        }
+        else if( *t=='%' ) //End marker of some benchmark sets
+            break;
+        else
+        {
+            string line(t,e);
+            char* end;
+            for( const char* l=line.c_str(); ; l=end )
+            {
+                long lit = strtol(l,&end,10);
+                if( end==l )
+                {
+                    if( *(l+skipWS(l)) )
+                    {
+                        printf("Error: Syntax Error line %lu in %s\n",linenum,filename);
+                        return false;
+                    }
+                    break;
+                }
+                if( !header )
+                {
+                    printf("Error: Clause before the DIMACS header line %lu in %s\n",linenum,filename);
+                    return false;
+                }
+                if( (unsigned long)labs(lit)>nvars )
+                {
+                    printf("Error: Variable %ld out of range line %lu in %s\n",labs(lit),linenum,filename);
+                    return false;
+                }
+                if( lit==0 )
+                {
+                    propositions.push_back(clause ? clause : hashCons(new False,OpFalse,0));
+                    clause.reset();
+                    continue;
+                }
+                const shared_ptr<Expr>& L = literals[2*(labs(lit)-1) + (lit<0)];
+                clause = clause ? hashCons(new Or(clause,L),OpOr,0,clause,L) : L;
+            }
+        }
+        s = e;
+    }
+    if( clause )
+        propositions.push_back(clause); //The last clause may omit its 0
+    if( !header )
+    {
+        printf("Error: No DIMACS header in %s\n",filename);
+        return false;
+    }
+    propositions.push_back(hashCons(new False,OpFalse,0));
+    return true;
+}
+
+//Command line options
+struct Options
+{
+    string engine;    //Search strategy
+    const char* simd; //Vector unit for the enumerator, null for the widest available
+    bool jit;
+    bool native;
+    bool gray;
+    bool progress;    //Report enumeration progress on stderr
+    U32 threads;      //Enumeration worker threads
+    U32 shard;        //Enumerate only shard i of N
+    U32 shards;
+    U32 processes;    //Worker processes forked by the coordinator, 0 for none
+    U32 checkpoint;   //Seconds between enumeration checkpoints, 0 for none
+    bool resume;      //Continue from a checkpoint
+    bool reorder;     //Reorder the axioms by how often they reject assignments
+    bool tile;        //Evaluate node by node over tiles of blocks
+    bool tables;      //Evaluate subformulas over few variables by table lookup
+    bool dimacs;      //Write the clause form instead of checking
+    string bddOrder;  //Initial BDD variable order
+    bool sift;        //Reorder BDD variables dynamically
+    bool aig;         //Optimize the program as an and-inverter graph
+    Options() : engine("enum"), simd(0), jit(false), native(false), gray(false), progress(false),
+                threads(1), shard(0), shards(1), processes(0), checkpoint(60), resume(false),
+                reorder(true), tile(false), tables(true), dimacs(false), bddOrder("force"),
+                sift(true), aig(true) {}
+};
+Options options; //Global for simplicity
+
+void printCounterexample(const vector<bool>& values)
+{
+    printf("Theorem is false!\n");
+    if(variables.size()>=1)
+    {
+        printf("Counterexample:\n");
+        printf("%40s Value\n","Proposition");
+    }
+    for(U32 j=0; j<variables.size(); j++)
+    {
+        if( values[j] )
+            printf("%40s True\n",variables[j].c_str());
+        else
+            printf("%40s False\n",variables[j].c_str());
+    }
+}
+
+//Writes clauses in DIMACS form, where variable v is numbered v+1. Comments name the
+//problem variables; the higher numbers belong to the encoding.
+void writeDimacs(FILE* out, const Cnf& cnf)
+{
+    fprintf(out,"c Axioms and negated theorem, satisfiable exactly when there is a counterexample\n");
+    for( size_t v=0; v<variables.size(); v++ )
+        fprintf(out,"c %lu [%s]\n",(unsigned long)v+1,variables[v].c_str());
+    fprintf(out,"p cnf %lu %lu\n",(unsigned long)cnf.vars,(unsigned long)cnf.clauses.size());
+    for( size_t i=0; i<cnf.clauses.size(); i++ )
+    {
+        for( size_t j=0; j<cnf.clauses[i].size(); j++ )
+        {
+            Lit l = cnf.clauses[i][j];
+            fprintf(out,"%s%lu ",l&1 ? "-" : "",(unsigned long)l/2+1);
+        }
+        fprintf(out,"0\n");
+    }
+}
+
+//SAT-based checking: the axioms together with the negated theorem are satisfiable exactly
+//when there is a counterexample; otherwise the axioms alone tell a verified theorem from
+//inconsistent axioms. Returns 1 with a counterexample, 0 if there is none and -1 when
+//cancelled. The portfolio runs CDCL.
+int satSearch(const Program& program, bool& consistent, vector<bool>& counterexample)
+{
+    U32 n = variables.size();
+    for( int pass=0; pass<2; pass++ )
+    {
+        Cnf cnf = encodeProgram(program,n,pass==0);
+        vector<signed char> model;
+        bool sat;
+        if( options.engine=="dpll" )
+        {
+            Dpll solver(cnf,n);
+            sat = solver.solve();
+            model = solver.value;
+        }
+        else
+        {
+            Cdcl solver(cnf);
+            sat = solver.solve();
+            model = solver.value;
+        }
+        if( cancelled )
+            return -1;
+        if( pass==1 || sat )
+        {
+            consistent = sat;
+            for( U32 v=0; sat && pass==0 && v<n; v++ )
+                counterexample.push_back(model[v]==1);
+            return pass==0 && sat;
+        }
+    }
+    return 0;
+}
+
+//Static BDD variable order. "dfs" takes the variables as a depth-first walk from the
+//propositions meets them, deeper operands first, so variables that feed one subformula
+//end up close. "force" then applies FORCE (Aloul et al.): every DAG node over 2 to 16
+//variables is a hyperedge, and each round moves every variable to the mean of its
+//hyperedges' centres of gravity, keeping the order with the smallest total span.
+//"appearance" is the order of the input.
+vector<U32> staticOrder(const Program& p, U32 nvars, const string& method)
+{
+    vector<U32> order;
+    if( method=="appearance" )
+    {
+        for( U32 v=0; v<nvars; v++ )
+            order.push_back(v);
+        return order;
+    }
 
-    return 0;
+    vector<U32> depth(p.code.size(),0);
+    for( size_t pc=0; pc<p.code.size(); pc++ )
+    {
+        const Insn& c = p.code[pc];
+        if( c.op>=OpNot )
+            depth[pc] = depth[c.a]+1;
+        if( c.op>OpNot )
+            depth[pc] = max(depth[pc],depth[c.b]+1);
+    }
+    vector<bool> visited(p.code.size(),false), placed(nvars,false);
+    for( size_t i=0; i<p.roots.size(); i++ )
+    {
+        vector<U32> stack(1,p.roots[i]);
+        while( !stack.empty() )
+        {
+            U32 pc = stack.back();
+            stack.pop_back();
+            if( visited[pc] )
+                continue;
+            visited[pc] = true;
+            const Insn& c = p.code[pc];
+            if( c.op==OpVar && !placed[c.a] )
+            {
+                placed[c.a] = true;
+                order.push_back(c.a);
+            }
+            else if( c.op>OpNot )
+            {
+                bool aFirst = depth[c.a]>=depth[c.b];
+                stack.push_back(aFirst ? c.b : c.a);
+                stack.push_back(aFirst ? c.a : c.b);
+            }
+            else if( c.op==OpNot )
+                stack.push_back(c.a);
+        }
+    }
+    for( U32 v=0; v<nvars; v++ )
+        if( !placed[v] )
+            order.push_back(v);
+    if( method!="force" || nvars<3 )
+        return order;
+
+    //Supports of the nodes, up to the largest hyperedge
+    const size_t MaxEdge = 16;
+    vector<vector<U32>> support(p.code.size());
+    vector<vector<U32>> edges;
+    for( size_t pc=0; pc<p.code.size(); pc++ )
+    {
+        const Insn& c = p.code[pc];
+        vector<U32>& s = support[pc];
+        if( c.op==OpVar )
+            s.push_back(c.a);
+        else if( c.op>=OpNot )
+        {
+            s = support[c.a];
+            if( c.op>OpNot )
+            {
+                vector<U32> merged;
+                set_union(s.begin(),s.end(),support[c.b].begin(),support[c.b].end(),
+                          back_inserter(merged));
+                s.swap(merged);
+            }
+            if( s.size()>MaxEdge || support[c.a].size()>MaxEdge ||
+                (c.op>OpNot && support[c.b].size()>MaxEdge) )
+                s.assign(MaxEdge+1,0); //Too wide to matter
+            else if( c.op>OpNot && s.size()>=2 )
+                edges.push_back(s);
+        }
+    }
+
+    vector<double> position(nvars);
+    for( U32 l=0; l<nvars; l++ )
+        position[order[l]] = l;
+    vector<U32> best = order;
+    double bestSpan = 1e300;
+    for( int round=0; round<64 && !edges.empty(); round++ )
+    {
+        double span = 0;
+        vector<double> sum(nvars,0), count(nvars,0);
+        for( size_t e=0; e<edges.size(); e++ )
+        {
+            double centre = 0, low = 1e300, high = -1;
+            for( size_t i=0; i<edges[e].size(); i++ )
+            {
+                double x = position[edges[e][i]];
+                centre += x;
+                low = min(low,x);
+                high = max(high,x);
+            }
+            centre /= edges[e].size();
+            span += high-low;
+            for( size_t i=0; i<edges[e].size(); i++ )
+            {
+                sum[edges[e][i]] += centre;
+                count[edges[e][i]]++;
+            }
+        }
+        if( span>=bestSpan )
+            break;
+        bestSpan = span;
+        best = order;
+        vector<pair<double,U32>> moved;
+        for( U32 v=0; v<nvars; v++ )
+            moved.push_back(make_pair(count[v] ? sum[v]/count[v] : position[v],v));
+        stable_sort(moved.begin(),moved.end());
+        for( U32 l=0; l<nvars; l++ )
+        {
+            order[l] = moved[l].second;
+            position[order[l]] = l;
+        }
+    }
+    return best;
+}
+
+//BDD-based checking: every DAG node gets its BDD once, in program order, and drops it
+//after its last user. The axioms' conjunction is false exactly when they are inconsistent,
+//and its conjunction with the negated theorem is false exactly when the theorem holds;
+//otherwise any path to true in it is a counterexample. Returns -1 when cancelled.
+int bddSearch(const Program& program, bool& consistent, vector<bool>& counterexample)
+{
+    U32 n = variables.size();
+    Bdd bdd(staticOrder(program,n,options.bddOrder),options.threads);
+    bdd.sifting = options.sift;
+    vector<U32> last(program.code.size(),0); //Last instruction using each node
+    for( size_t pc=0; pc<program.code.size(); pc++ )
+    {
+        const Insn& c = program.code[pc];
+        if( c.op>=OpNot )
+            last[c.a] = pc;
+        if( c.op>OpNot )
+            last[c.b] = pc;
+    }
+    for( size_t i=0; i<program.roots.size(); i++ )
+        last[program.roots[i]] = U32(-1);
+
+    vector<Bdd::Edge> node(program.code.size());
+    for( size_t pc=0; pc<program.code.size(); pc++ )
+    {
+        const Insn& c = program.code[pc];
+        switch( c.op )
+        {
+        case OpFalse: node[pc] = Bdd::False; break;
+        case OpTrue: node[pc] = Bdd::True; break;
+        case OpVar: node[pc] = bdd.var(c.a); break;
+        case OpNot: node[pc] = node[c.a]^1; break;
+        default: node[pc] = bdd.apply(c.op,node[c.a],node[c.b]); break;
+        }
+        bdd.ref(node[pc]);
+        if( c.op>=OpNot && last[c.a]==pc )
+            bdd.deref(node[c.a]);
+        if( c.op>OpNot && c.b!=c.a && last[c.b]==pc )
+            bdd.deref(node[c.b]);
+        bdd.checkpoint();
+        if( cancelled )
+            return -1;
+    }
+
+    Bdd::Edge axioms = Bdd::True;
+    for( size_t i=0; i+1<program.roots.size(); i++ )
+    {
+        Bdd::Edge next = bdd.bddAnd(axioms,node[program.roots[i]]);
+        bdd.ref(next);
+        bdd.deref(axioms);
+        axioms = next;
+        bdd.checkpoint();
+    }
+    Bdd::Edge f = bdd.bddAnd(axioms,node[program.roots.back()]^1);
+    if( cancelled )
+        return -1;
+    consistent = axioms!=Bdd::False;
+    if( f==Bdd::False )
+        return 0;
+    counterexample = bdd.model(f);
+    return 1;
+}
+
+//Creates the evaluator selected by the options, or reports why it cannot
+shared_ptr<Evaluator> makeEvaluator(const Program& program, const Isa* isa, U64 blocks)
+{
+    if( options.jit )
+    {
+#ifdef HAVE_JIT
+        shared_ptr<JitEvaluator> j(new JitEvaluator(program,options.reorder));
+        if( j->code )
+            return j;
+        printf("Error: Cannot allocate executable memory for --jit\n");
+#else
+        printf("Error: --jit is only supported on x86-64\n");
+#endif
+        return shared_ptr<Evaluator>();
+    }
+    if( options.native )
+    {
+#ifdef HAVE_DLOPEN
+        shared_ptr<NativeEvaluator> c(new NativeEvaluator(program,blocks>=8 ? 8 : 1));
+        if( c->fn )
+            return c;
+        printf("Error: %s\n",c->error.c_str());
+#else
+        printf("Error: --compile is not supported on this platform\n");
+#endif
+        return shared_ptr<Evaluator>();
+    }
+    if( options.gray )
+        return shared_ptr<Evaluator>(new GrayEvaluator(program,variables.size()));
+    if( options.tile && blocks>=TileWords )
+        return shared_ptr<Evaluator>(new TileEvaluator(program,isa,options.reorder));
+    return shared_ptr<Evaluator>(new VmEvaluator(program,isa,options.reorder));
+}
+
+//State shared by the enumeration workers. The blocks left to enumerate are cut into
+//slices, and each worker owns a deque of block ranges. Owners take slices from the low
+//end of their front range. An idle worker steals the back range of another worker, or
+//the upper half of its last range, so the cores stay busy however unevenly the axioms
+//cut the work; at the start everything sits with worker 0 and spreads by stealing.
+//Ranges starting beyond the best counterexample found so far are dropped; every slice
+//below it is still finished, so the result is the smallest counterexample, as in a
+//sequential run. Finished slices are recorded for checkpoints.
+struct Sweep
+{
+    struct Range
+    {
+        U64 lo; //First block
+        U64 hi; //One past the last block
+    };
+    struct WorkQueue
+    {
+        mutex m;
+        deque<Range> ranges;
+    };
+
+    U64 unit;         //Range boundaries are multiples of this many blocks
+    U64 slice;        //Blocks per slice
+    U64 valid;        //Assignments that exist in a block
+    vector<WorkQueue> queues;
+    atomic<bool> consistent;
+    atomic<bool> found;
+    atomic<bool> stop; //Set to abandon the sweep
+    atomic<U64> best;  //Smallest counterexample so far, when found
+    atomic<U64> done;  //Blocks finished, for progress
+    mutex finishedMutex;
+    map<U64,U64> finished; //Finished ranges without a counterexample, lo -> hi, merged
+
+    Sweep(const vector<Range>& todo, U64 unit_in, U64 slice_in, U64 valid_in, U32 threads) :
+        unit(unit_in), slice(slice_in), valid(valid_in), queues(threads), consistent(false),
+        found(false), stop(false), best(~U64(0)), done(0)
+    {
+        queues[0].ranges.insert(queues[0].ranges.end(),todo.begin(),todo.end());
+    }
+
+    bool needed(U64 b) { return !stop && !cancelled && (!found || b*64<=best); }
+
+    //Takes the next slice from the worker's own deque
+    bool take(U32 t, Range& s)
+    {
+        WorkQueue& q = queues[t];
+        lock_guard<mutex> lock(q.m);
+        while( !q.ranges.empty() )
+        {
+            Range& r = q.ranges.front();
+            if( r.lo<r.hi && needed(r.lo) )
+            {
+                s.lo = r.lo;
+                s.hi = r.lo = min(r.hi,r.lo+slice);
+                if( r.lo==r.hi )
+                    q.ranges.pop_front();
+                return true;
+            }
+            q.ranges.pop_front();
+        }
+        return false;
+    }
+
+    //Takes the next slice for worker t, stealing when its deque runs dry
+    bool next(U32 t, Range& s)
+    {
+        while( true )
+        {
+            if( take(t,s) )
+                return true;
+            bool stole = false;
+            for( U32 k=1; k<queues.size() && !stole; k++ )
+            {
+                WorkQueue& v = queues[(t+k)%queues.size()];
+                Range r;
+                {
+                    lock_guard<mutex> lock(v.m);
+                    if( v.ranges.size()>1 )
+                    {
+                        r = v.ranges.back();
+                        v.ranges.pop_back();
+                    }
+                    else if( v.ranges.size()==1 && v.ranges.front().hi-v.ranges.front().lo>=2*unit )
+                    {
+                        Range& f = v.ranges.front();
+                        r.hi = f.hi;
+                        r.lo = f.hi = f.hi-(f.hi-f.lo)/2/unit*unit;
+                    }
+                    else
+                        continue;
+                }
+                if( !needed(r.lo) )
+                    continue;
+                lock_guard<mutex> lock(queues[t].m);
+                queues[t].ranges.push_back(r);
+                stole = true;
+            }
+            if( !stole )
+                return false;
+        }
+    }
+
+    //Records a finished range, merging it with its neighbours
+    void finish(Range r)
+    {
+        lock_guard<mutex> lock(finishedMutex);
+        map<U64,U64>::iterator after = finished.lower_bound(r.lo);
+        if( after!=finished.begin() )
+        {
+            map<U64,U64>::iterator before = after;
+            before--;
+            if( before->second==r.lo )
+            {
+                r.lo = before->first;
+                finished.erase(before);
+            }
+        }
+        if( after!=finished.end() && after->first==r.hi )
+        {
+            r.hi = after->second;
+            finished.erase(after);
+        }
+        finished[r.lo] = r.hi;
+    }
+
+    void run(Evaluator* eval, U32 t)
+    {
+        Range s;
+        while( next(t,s) )
+        {
+            bool sat = false;
+            U64 x;
+            bool bad = eval->scan(s.lo,s.hi,valid,sat,x);
+            if( sat )
+                consistent = true;
+            if( bad )
+            {
+                U64 cur = best;
+                while( x<cur && !best.compare_exchange_weak(cur,x) ) {}
+                found = true;
+            }
+            else
+                finish(s);
+            done += s.hi-s.lo;
+        }
+    }
+};
+
+//Checkpoints of long enumerations live in propcheck-<hash>.ckpt in the working directory,
+//named after a hash of the compiled problem and the shard, and list the finished block
+//ranges. They are removed once the enumeration completes.
+string checkpointName(const Program& program)
+{
+    string key;
+    char buf[64];
+    for( size_t i=0; i<program.code.size(); i++ )
+    {
+        snprintf(buf,sizeof(buf),"%lu %lu %lu;",(unsigned long)program.code[i].op,
+                 (unsigned long)program.code[i].a,(unsigned long)program.code[i].b);
+        key += buf;
+    }
+    for( size_t i=0; i<program.roots.size(); i++ )
+    {
+        snprintf(buf,sizeof(buf),"r%lu;",(unsigned long)program.roots[i]);
+        key += buf;
+    }
+    for( size_t i=0; i<variables.size(); i++ )
+        key += variables[i]+"]";
+    snprintf(buf,sizeof(buf),"%lu/%lu",(unsigned long)options.shard,(unsigned long)options.shards);
+    key += buf;
+    snprintf(buf,sizeof(buf),"propcheck-%016llx.ckpt",fnv1a(key));
+    return buf;
+}
+
+bool saveCheckpoint(const string& name, Sweep& sweep)
+{
+    string tmp = name+".tmp";
+    FILE* f = fopen(tmp.c_str(),"wb");
+    if( !f )
+        return false;
+    fprintf(f,"propcheck checkpoint\nconsistent %d\n",int(sweep.consistent));
+    {
+        lock_guard<mutex> lock(sweep.finishedMutex);
+        for( map<U64,U64>::iterator it=sweep.finished.begin(); it!=sweep.finished.end(); it++ )
+            fprintf(f,"done %llu %llu\n",it->first,it->second);
+    }
+    bool ok = !ferror(f);
+    ok = !fclose(f) && ok;
+    return ok && !rename(tmp.c_str(),name.c_str());
+}
+
+bool loadCheckpoint(const string& name, bool& consistent, map<U64,U64>& finished)
+{
+    FILE* f = fopen(name.c_str(),"rb");
+    if( !f )
+        return false;
+    char line[256];
+    bool ok = fgets(line,sizeof(line),f) && string(line)=="propcheck checkpoint\n";
+    while( ok && fgets(line,sizeof(line),f) )
+    {
+        int c;
+        unsigned long long lo, hi;
+        if( sscanf(line,"consistent %d",&c)==1 )
+            consistent = c!=0;
+        else if( sscanf(line,"done %llu %llu",&lo,&hi)==2 && lo<hi )
+            finished[lo] = hi;
+        else
+            ok = false;
+    }
+    fclose(f);
+    return ok;
+}
+
+volatile sig_atomic_t interrupted = 0;
+void onInterrupt(int) { interrupted = 1; }
+
+//Exhaustive enumeration. Returns 1 with the smallest counterexample, 0 if there is none
+//and -1 on errors, which are reported here, or when cancelled.
+int enumerate(const Program& program, bool& consistent, vector<bool>& counterexample)
+{
+    const Isa* isa = selectIsa(options.simd);
+    if( !isa )
+    {
+        printf("Error: %s is not supported on this CPU\n", options.simd);
+        return -1;
+    }
+
+    //Enumerate assignments a run of 64-assignment blocks at a time, one bit per assignment
+    U32 n = variables.size();
+    if( n>64 )
+    {
+        printf("Error: %lu variables are too many to enumerate (at most 64), "
+               "use --engine=cdcl, bdd or prune\n",(unsigned long)n);
+        return -1;
+    }
+    U64 blocks = n>6 ? U64(1)<<(n-6) : 1;
+    U64 valid = n>=6 ? ~U64(0) : (U64(1)<<(U64(1)<<n))-1; //Assignments that exist
+    if( blocks<isa->words ) //Small problems go block by block
+        isa = &scalarIsa;
+
+    //A shard is a contiguous range of whole 2^12-block units (the high bits of the
+    //assignment when the shard count is a power of two)
+    U64 unit = min(blocks,U64(1)<<12);
+    U64 units = blocks/unit;
+    U64 first = unit*(units/options.shards*options.shard + min(U64(options.shard),units%options.shards));
+    U64 end = unit*(units/options.shards*(options.shard+1) + min(U64(options.shard+1),units%options.shards));
+    if( first==end )
+        return 0;
+
+    //Skip what an earlier run already finished
+    string checkpoint = checkpointName(program);
+    map<U64,U64> resumed;
+    bool resumedConsistent = false;
+    if( options.resume && !loadCheckpoint(checkpoint,resumedConsistent,resumed) )
+    {
+        fprintf(stderr,"No usable checkpoint %s, starting from the beginning\n",checkpoint.c_str());
+        resumed.clear();
+        resumedConsistent = false;
+    }
+    vector<Sweep::Range> todo;
+    U64 pos = first;
+    U64 skipped = 0;
+    for( map<U64,U64>::iterator it=resumed.begin(); it!=resumed.end(); it++ )
+    {
+        U64 lo = max(it->first,pos), hi = min(it->second,end);
+        if( lo>=hi || lo%unit || hi%unit )
+            continue;
+        if( pos<lo )
+        {
+            Sweep::Range r = { pos, lo };
+            todo.push_back(r);
+        }
+        skipped += hi-lo;
+        pos = hi;
+    }
+    if( pos<end )
+    {
+        Sweep::Range r = { pos, end };
+        todo.push_back(r);
+    }
+
+    //Slices are powers of two between 2^12 and 2^16 blocks, aiming at 16 per thread
+    U32 threads = max(options.threads,U32(1));
+    U64 slice = U64(1)<<16;
+    while( slice>unit && (end-first-skipped)/slice<16*threads )
+        slice >>= 1;
+    threads = U32(max(U64(1),min(U64(threads),(end-first-skipped)/slice)));
+
+    Program tabulated = options.tables ? tabulateProgram(program) : program;
+    vector<shared_ptr<Evaluator>> evals;
+    for( U32 t=0; t<threads; t++ )
+    {
+        evals.push_back(makeEvaluator(tabulated,isa,blocks));
+        if( !evals.back() )
+            return -1;
+    }
+
+    Sweep sweep(todo,unit,slice,valid,threads);
+    sweep.consistent = resumedConsistent;
+    sweep.done = skipped;
+    for( map<U64,U64>::iterator it=resumed.begin(); it!=resumed.end(); it++ )
+        sweep.finish(Sweep::Range{ it->first, it->second });
+    mutex m;
+    condition_variable finished;
+    U32 running = threads;
+    vector<thread> workers;
+    for( U32 t=0; t<threads; t++ )
+        workers.push_back(thread([&,t]()
+        {
+            sweep.run(evals[t].get(),t);
+            lock_guard<mutex> lock(m);
+            running--;
+            finished.notify_one();
+        }));
+
+    //Wait for the workers, reporting progress and saving checkpoints along the way
+    void (*oldInt)(int) = SIG_DFL, (*oldTerm)(int) = SIG_DFL;
+    if( options.checkpoint )
+    {
+        oldInt = signal(SIGINT,onInterrupt);
+        oldTerm = signal(SIGTERM,onInterrupt);
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now(), saved = start;
+    bool shown = false;
+    {
+        unique_lock<mutex> lock(m);
+        while( running>0 )
+        {
+            if( finished.wait_for(lock,chrono::seconds(1))!=cv_status::timeout )
+                continue;
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            if( interrupted )
+                sweep.stop = true;
+            if( options.checkpoint && now-saved>=chrono::seconds(options.checkpoint) && !sweep.found )
+            {
+                if( !saveCheckpoint(checkpoint,sweep) )
+                    fprintf(stderr,"Warning: Cannot write checkpoint %s\n",checkpoint.c_str());
+                saved = now;
+            }
+            if( options.progress )
+            {
+                double total = double(end-first);
+                double elapsed = chrono::duration<double>(now-start).count();
+                double rate = (double(sweep.done)-double(skipped))/elapsed;
+                fprintf(stderr,"\rChecked %6.2f%% of %s2^%lu assignments, %.0fs left   ",
+                        100*double(sweep.done)/total,options.shards>1 ? "a shard of " : "",
+                        (unsigned long)n,rate>0 ? (total-double(sweep.done))/rate : 0.0);
+                shown = true;
+            }
+        }
+    }
+    for( U32 t=0; t<threads; t++ )
+        workers[t].join();
+    if( shown )
+        fprintf(stderr,"\n");
+    if( options.checkpoint )
+    {
+        signal(SIGINT,oldInt);
+        signal(SIGTERM,oldTerm);
+    }
+
+    if( cancelled )
+        return -1;
+    if( sweep.stop )
+    {
+        if( saveCheckpoint(checkpoint,sweep) )
+            fprintf(stderr,"Interrupted, progress saved in %s; rerun with --resume to continue\n",
+                    checkpoint.c_str());
+        return -1;
+    }
+    if( saved!=start || options.resume )
+        remove(checkpoint.c_str());
+
+    consistent = sweep.consistent;
+    if( !sweep.found )
+        return 0;
+    U64 x = sweep.best;
+    for( U32 j=0; j<variables.size(); j++ )
+        counterexample.push_back(((x>>j) & 1)!=0);
+    return 1;
+}
+
+#ifdef HAVE_FORK
+//What a shard worker process reports back to the coordinator
+struct ShardResult
+{
+    int found;      //As returned by enumerate
+    int consistent;
+    U64 x;          //Smallest counterexample in the shard
+};
+
+//Forks a worker process per shard, each running the enumerator on its shard, and combines
+//their results. Once shard i reports a counterexample the workers of later shards are
+//killed, while earlier shards still finish, so the result is the smallest counterexample.
+int coordinate(const Program& program, U32 shards, bool& consistent, vector<bool>& counterexample)
+{
+    vector<pid_t> pids(shards,-1);
+    vector<int> fds(shards,-1);
+    vector<ShardResult> results(shards);
+    fflush(stdout);
+    fflush(stderr);
+    for( U32 i=0; i<shards; i++ )
+    {
+        int p[2];
+        if( pipe(p) )
+        {
+            printf("Error: Cannot create a pipe for shard %lu\n",(unsigned long)i);
+            shards = i;
+            break;
+        }
+        pid_t pid = fork();
+        if( pid==0 ) //Worker
+        {
+            close(p[0]);
+            options.shard = i;
+            options.shards = shards;
+            options.progress = false;
+            ShardResult r = { 0, 0, 0 };
+            bool c = false;
+            vector<bool> cex;
+            r.found = enumerate(program,c,cex);
+            r.consistent = c;
+            for( size_t j=0; j<cex.size(); j++ )
+                r.x |= U64(cex[j])<<j;
+            if( write(p[1],&r,sizeof(r))!=sizeof(r) )
+                r.found = -1;
+            fflush(stdout);
+            _exit(r.found<0);
+        }
+        close(p[1]);
+        if( pid<0 )
+        {
+            close(p[0]);
+            printf("Error: Cannot fork a worker for shard %lu\n",(unsigned long)i);
+            shards = i;
+            break;
+        }
+        pids[i] = pid;
+        fds[i] = p[0];
+    }
+    if( shards<pids.size() ) //Could not start every worker
+    {
+        for( U32 i=0; i<shards; i++ )
+            kill(pids[i],SIGKILL);
+        for( U32 i=0; i<shards; i++ )
+            waitpid(pids[i],0,0);
+        return -1;
+    }
+
+    //Collect results until every shard before the first counterexample has reported
+    U32 bestShard = shards;
+    U32 reported = 0;
+    bool failed = false;
+    while( true )
+    {
+        vector<pollfd> waiting;
+        for( U32 i=0; i<bestShard; i++ )
+            if( fds[i]>=0 )
+            {
+                pollfd pf = { fds[i], POLLIN, 0 };
+                waiting.push_back(pf);
+            }
+        if( waiting.empty() )
+            break;
+        if( poll(waiting.data(),waiting.size(),-1)<0 )
+            continue;
+        for( size_t k=0; k<waiting.size(); k++ )
+        {
+            if( !waiting[k].revents )
+                continue;
+            U32 i = 0;
+            while( fds[i]!=waiting[k].fd )
+                i++;
+            if( read(fds[i],&results[i],sizeof(ShardResult))!=sizeof(ShardResult) )
+                results[i].found = -1;
+            close(fds[i]);
+            fds[i] = -1;
+            reported++;
+            if( options.progress )
+                fprintf(stderr,"\rShards finished: %lu/%lu   ",(unsigned long)reported,(unsigned long)shards);
+            if( results[i].found<0 )
+            {
+                printf("Error: Worker for shard %lu/%lu failed\n",(unsigned long)i,(unsigned long)shards);
+                failed = true;
+            }
+            if( results[i].found>0 && i<bestShard )
+                bestShard = i;
+            consistent = consistent || results[i].consistent;
+        }
+        if( failed )
+            break;
+    }
+    if( options.progress && reported )
+        fprintf(stderr,"\n");
+
+    for( U32 i=0; i<shards; i++ )
+    {
+        if( fds[i]>=0 ) //Made redundant by an earlier counterexample
+        {
+            kill(pids[i],SIGKILL);
+            close(fds[i]);
+        }
+        waitpid(pids[i],0,0);
+    }
+    if( failed )
+        return -1;
+    if( bestShard==shards )
+        return 0;
+    for( U32 j=0; j<variables.size(); j++ )
+        counterexample.push_back(((results[bestShard].x>>j) & 1)!=0);
+    return 1;
+}
+#endif
+
+//Portfolio: the enumerator, CDCL and the BDD engine race on threads of their own over the
+//same program. The first definitive answer wins and cancels the others. The enumerator
+//only enters with at most 64 variables, and saves no checkpoints, which could only resume
+//a race. Returns like the engines, with the name of the one that answered in winner.
+int portfolio(const Program& program, bool& consistent, vector<bool>& counterexample,
+              string& winner)
+{
+    struct Engine
+    {
+        const char* name;
+        int (*search)(const Program&, bool&, vector<bool>&);
+    };
+    vector<Engine> engines;
+    if( variables.size()<=64 )
+        engines.push_back(Engine{ "enum", enumerate });
+    engines.push_back(Engine{ "cdcl", satSearch });
+    engines.push_back(Engine{ "bdd", bddSearch });
+    options.checkpoint = 0;
+    options.resume = false;
+
+    mutex m;
+    int found = -1;
+    vector<thread> threads;
+    for( size_t i=0; i<engines.size(); i++ )
+        threads.push_back(thread([&,i]()
+        {
+            bool c = false;
+            vector<bool> x;
+            int r = engines[i].search(program,c,x);
+            lock_guard<mutex> lock(m);
+            if( r<0 || found>=0 )
+                return;
+            found = r;
+            consistent = c;
+            counterexample = x;
+            winner = engines[i].name;
+            cancelled = true;
+        }));
+    for( size_t i=0; i<threads.size(); i++ )
+        threads[i].join();
+    return found;
 }
 
 int main(int argc, char* argv[])
 {
     vector<shared_ptr<Expr>> propositions;
-    if( argc<2 )
+    const char* filename = 0;
+    for( int a=1; a<argc; a++ )
+    {
+        if( parseString(argv[a],"--engine=") )
+            options.engine = argv[a]+9;
+        else if( parseString(argv[a],"--simd=") )
+            options.simd = argv[a]+7;
+        else if( string(argv[a])=="--jit" )
+            options.jit = true;
+        else if( string(argv[a])=="--compile" )
+            options.native = true;
+        else if( string(argv[a])=="--gray" )
+            options.gray = true;
+        else if( string(argv[a])=="--tile" )
+            options.tile = true;
+        else if( string(argv[a])=="--no-tables" )
+            options.tables = false;
+        else if( string(argv[a])=="--progress" )
+            options.progress = true;
+        else if( parseString(argv[a],"--checkpoint=") )
+            options.checkpoint = strtoul(argv[a]+13,0,10);
+        else if( string(argv[a])=="--resume" )
+            options.resume = true;
+        else if( string(argv[a])=="--no-reorder" )
+            options.reorder = false;
+        else if( string(argv[a])=="--emit-dimacs" )
+            options.dimacs = true;
+        else if( parseString(argv[a],"--bdd-order=") )
+            options.bddOrder = argv[a]+12;
+        else if( string(argv[a])=="--no-sift" )
+            options.sift = false;
+        else if( string(argv[a])=="--no-aig" )
+            options.aig = false;
+        else if( parseString(argv[a],"-j") )
+        {
+            const char* j = argv[a][2] ? argv[a]+2 : a+1<argc ? argv[++a] : "";
+            options.threads = strtoul(j,0,10);
+            if( options.threads<1 )
+            {
+                printf("Error: -j needs a number of threads\n");
+                return 1;
+            }
+        }
+        else if( string(argv[a])=="--shard" && a+1<argc )
+        {
+            unsigned long i, n;
+            if( sscanf(argv[++a],"%lu/%lu",&i,&n)!=2 || n<1 || i>=n )
+            {
+                printf("Error: --shard needs i/N with 0 <= i < N\n");
+                return 1;
+            }
+            options.shard = i;
+            options.shards = n;
+        }
+        else if( string(argv[a])=="--coordinate" && a+1<argc )
+        {
+            options.processes = strtoul(argv[++a],0,10);
+            if( options.processes<1 )
+            {
+                printf("Error: --coordinate needs a number of worker processes\n");
+                return 1;
+            }
+        }
+        else if( argv[a][0]=='-' )
+        {
+            printf("Error: Unknown option %s\n", argv[a]);
+            return 1;
+        }
+        else
+            filename = argv[a];
+    }
+    if( !filename )
+    {
+        printf("Usage: propcheck [options] <filename>\n");
+        return 1;
+    }
+    if( options.engine!="enum" && options.engine!="prune" && options.engine!="dpll" &&
+        options.engine!="cdcl" && options.engine!="bdd" && options.engine!="portfolio" )
     {
-        printf("Usage: propcheck <filename>\n");
+        printf("Error: Unknown engine %s\n", options.engine.c_str());
+        return 1;
+    }
+    if( options.engine!="enum" && (options.shards>1 || options.processes) )
+    {
+        printf("Error: --engine=%s checks the whole problem, --shard and --coordinate need enum\n",
+               options.engine.c_str());
+        return 1;
+    }
+    if( options.bddOrder!="force" && options.bddOrder!="dfs" && options.bddOrder!="appearance" )
+    {
+        printf("Error: Unknown BDD order %s\n", options.bddOrder.c_str());
         return 1;
     }
 
-    FILE* f = fopen(argv[1],"rb");
+    FILE* f = fopen(filename,"rb");
     if(!f)
     {
-        printf("Error: Cannot open %s\n", argv[1]);
+        printf("Error: Cannot open %s\n", filename);
         return 1;
     }
+    size_t length = strlen(filename);
+    bool dimacs = length>4 && string(filename+length-4)==".cnf";
+    if( dimacs && !readDimacs(f,filename,propositions) )
+        return 1;
     char line[8192*2];
     unsigned long linenum = 0;
-    while(fgets(line,8192*2,f))
+    while( !dimacs && fgets(line,8192*2,f) )
     {
         linenum++;
         if(line[0]=='/' && line[1]=='/') //Skip Comments
@@ -373,7 +4873,7 @@ int main(int argc, char* argv[])
         shared_ptr<Expr> p;
         if(!parseTopLevelExpr(line,p))
         {
-            printf("Error: Syntax Error line %lu in %s\n",linenum,argv[1]);
+            printf("Error: Syntax Error line %lu in %s\n",linenum,filename);
             return 1;
         }
         propositions.push_back(p);
@@ -382,44 +4882,64 @@ int main(int argc, char* argv[])
 
     if( propositions.size()<1 )
     {
-        printf("Error: No theorem to check in %s\n",argv[1]);
+        printf("Error: No theorem to check in %s\n",filename);
         return 1;
     }
 
-    U32 max = 1;
-    for( int i=1; i<variables.size(); i++ )
+    Program program = compileProgram(propositions);
+    if( options.aig )
+        program = optimizeProgram(program);
+    if( options.dimacs )
     {
-        max|=(1<<i);
+        writeDimacs(stdout,encodeProgram(program,variables.size(),true));
+        return 0;
     }
-
     bool axiomsConsistent = false;
-    for( U32 x=0; x<=max; x++ )
+    vector<bool> counterexample;
+    string winner; //Engine that answered for the portfolio
+    int found;
+    if( options.engine=="prune" )
     {
-        //Check Axioms
-        int i;
-        for( i=0; i<propositions.size()-1; i++ )
-            if( !(*propositions[i])(x) ) //if axiom is not true
-                break;
-        if( i!=propositions.size()-1 ) //axioms not satisfied
-            continue;
-        axiomsConsistent = true;
-        if( !(*propositions[i])(x) ) //if theorem is not satisfied, we have a counterexample
-        {
-            printf("Theorem is false!\n");
-            if(variables.size()>=1)
-            {
-                printf("Counterexample:\n");
-                printf("%40s Value\n","Proposition");
-            }
-            for(U32 j=0; j<variables.size(); j++)
-            {
-                if( (U32(1)<<j)&x )
-                    printf("%40s True\n",variables[j].c_str());
-                else
-                    printf("%40s False\n",variables[j].c_str());
-            }
-            return 1;
-        }
+        PruneSearch search(program,variables.size());
+        found = search.search(0);
+        axiomsConsistent = search.consistent;
+        for( size_t j=0; found && j<variables.size(); j++ )
+            counterexample.push_back(search.a[j]==1);
+    }
+    else if( options.engine=="dpll" || options.engine=="cdcl" )
+        found = satSearch(program,axiomsConsistent,counterexample);
+    else if( options.engine=="bdd" )
+        found = bddSearch(program,axiomsConsistent,counterexample);
+    else if( options.engine=="portfolio" )
+        found = portfolio(program,axiomsConsistent,counterexample,winner);
+    else if( options.processes )
+    {
+#ifdef HAVE_FORK
+        found = coordinate(program,options.processes,axiomsConsistent,counterexample);
+#else
+        printf("Error: --coordinate is not supported on this platform\n");
+        return 1;
+#endif
+    }
+    else
+        found = enumerate(program,axiomsConsistent,counterexample);
+    if( found<0 )
+        return 1;
+    if( !winner.empty() )
+        printf("Answered first by the %s engine\n",winner.c_str());
+    if( found )
+    {
+        printCounterexample(counterexample);
+        return 1;
+    }
+
+    //A shard alone cannot verify the theorem, it only reports what it saw
+    if( options.shards>1 )
+    {
+        printf("No counterexample in shard %lu/%lu, axioms are %s there\n",
+               (unsigned long)options.shard,(unsigned long)options.shards,
+               axiomsConsistent ? "satisfiable" : "not satisfiable");
+        return 0;
     }
 
     if( !axiomsConsistent )